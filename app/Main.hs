@@ -47,6 +47,10 @@ defaultProject =
           , projectEchoCompilationCommand = False
           , projectCanExecute = False
           , projectFilePathPrintLength = FullPath
+          , projectSkipIdenticalBuilds = False
+          , projectPgo = NoPgo
+          , projectLto = False
+          , projectMarch = ""
           }
 
 -- | Starting point of the application.
@@ -58,10 +62,14 @@ main = do setLocaleEncoding utf8
               logMemory = LogMemory `elem` otherOptions
               noCore = NoCore `elem` otherOptions
               optimize = Optimize `elem` otherOptions
+              pgo = setPgoFromOptions otherOptions
+              profile = Profile `elem` otherOptions
               projectWithFiles = defaultProject { projectCFlags = (if logMemory then ["-D LOG_MEMORY"] else []) ++
                                                                   (if optimize then ["-O3 -D OPTIMIZE"] else []) ++
+                                                                  (if profile then profileFlags else []) ++
                                                                   (projectCFlags defaultProject),
-                                                  projectCore = not noCore}
+                                                  projectCore = not noCore,
+                                                  projectPgo = pgo}
               noArray = False
               coreModulesToLoad = if noCore then [] else (coreModules (projectCarpDir projectWithCarpDir))
               projectWithCarpDir = case lookup "CARP_DIR" sysEnv of
@@ -106,6 +114,9 @@ main = do setLocaleEncoding utf8
 data OtherOptions = NoCore
                   | LogMemory
                   | Optimize
+                  | PgoGenerateOption
+                  | PgoUseOption
+                  | Profile
                   | SetPrompt String
                   deriving (Show, Eq)
 
@@ -124,6 +135,9 @@ parseArgs args = parseArgsInternal [] Repl [] args
             "--no-core" -> parseArgsInternal filesToLoad execMode (NoCore : otherOptions) restArgs
             "--log-memory" -> parseArgsInternal filesToLoad execMode (LogMemory : otherOptions) restArgs
             "--optimize" -> parseArgsInternal filesToLoad execMode (Optimize : otherOptions) restArgs
+            "--pgo-generate" -> parseArgsInternal filesToLoad execMode (PgoGenerateOption : otherOptions) restArgs
+            "--pgo-use" -> parseArgsInternal filesToLoad execMode (PgoUseOption : otherOptions) restArgs
+            "--profile" -> parseArgsInternal filesToLoad execMode (Profile : otherOptions) restArgs
             "--prompt" -> case restArgs of
                              newPrompt : restRestArgs ->
                                parseArgsInternal filesToLoad execMode (SetPrompt newPrompt : otherOptions) restRestArgs
@@ -138,3 +152,17 @@ setCustomPromptFromOptions project (o:os) =
     _ -> setCustomPromptFromOptions project os
 setCustomPromptFromOptions project _ =
   project
+
+-- | Links the sampling profiler in core/carp_profile.h into the executable. It walks frame pointers
+-- | and needs the symbols of the executable to be exported to find the names of functions.
+profileFlags :: [String]
+profileFlags =
+  case platform of
+    Linux -> ["-D CARP_PROFILE -D _GNU_SOURCE -fno-omit-frame-pointer -rdynamic -ldl"]
+    _ -> ["-D CARP_PROFILE -fno-omit-frame-pointer -rdynamic"]
+
+setPgoFromOptions :: [OtherOptions] -> PgoMode
+setPgoFromOptions otherOptions
+  | PgoUseOption `elem` otherOptions = PgoUse
+  | PgoGenerateOption `elem` otherOptions = PgoGenerate
+  | otherwise = NoPgo
@@ -1,13 +1,54 @@
 #!/bin/bash
 
+# Runs every benchmark in ./bench. Results are printed and, with --save,
+# also written as CSV. With --baseline, each benchmark is compared against
+# an earlier CSV and the script fails if any median slowed down by more
+# than --threshold percent (default 5).
+#
+# Usage: ./benchmarks.sh [--save <file>] [--baseline <file>] [--threshold <percent>]
+
 set -e; # will make the script stop if there are any errors
+set -u; # will make the script stop if there is use of undefined
+
+SAVE=""
+BASELINE=""
+THRESHOLD=5
+while [[ $# -gt 0 ]]; do
+    case "$1" in
+        --save) SAVE="$2"; shift 2 ;;
+        --baseline) BASELINE="$2"; shift 2 ;;
+        --threshold) THRESHOLD="$2"; shift 2 ;;
+        *) echo "Unknown argument: $1"; exit 1 ;;
+    esac
+done
+
+# `carp -x` doesn't pass on the exit status of the program, so regressions
+# are found in the CSV results instead. Without --save they go to a
+# temporary file.
+RESULTS="${SAVE}"
+if [[ -z "${RESULTS}" ]]; then
+    RESULTS=$(mktemp)
+    trap 'rm -f "${RESULTS}"' EXIT
+fi
+rm -f "${RESULTS}"
+export CARP_BENCH_OUTPUT="${RESULTS}"
+export CARP_BENCH_FORMAT=csv
+if [[ -n "${BASELINE}" ]]; then
+    export CARP_BENCH_BASELINE="${BASELINE}"
+fi
+export CARP_BENCH_THRESHOLD="${THRESHOLD}"
 
 stack build;
 stack install;
 
-# Actual tests (using the test suite)
 for f in ./bench/*.carp; do
     echo $f
     carp -x --optimize $f
     echo
 done
+
+if grep -q ',true$' "${RESULTS}"; then
+    echo "Benchmark regressions found:"
+    grep ',true$' "${RESULTS}" | cut -d, -f1
+    exit 1
+fi
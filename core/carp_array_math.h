@@ -0,0 +1,287 @@
+#pragma once
+#include <string.h>
+
+#include <core.h>
+#include <carp_simd.h>
+
+/* Kernels behind Array.sum, minimum, maximum, element-count, dot, axpy! and
+ * prefix-sum for arrays of Int, Float and Double, written against the Simd
+ * vector types, and for arrays of Long, written with independent
+ * accumulators so that the compiler can vectorize them. They implement the
+ * array-* interfaces in Array.carp, which is how the generic functions end
+ * up here for these element types.
+ *
+ * Float and Double sums are pairwise: blocks of CARP_ARRAY_PAIRWISE_BLOCK
+ * elements are summed in vector lanes, and the block sums are added up as a
+ * binary tree, so the rounding error grows with log(n) instead of n. */
+
+#ifndef CARP_ARRAY_PAIRWISE_BLOCK
+#define CARP_ARRAY_PAIRWISE_BLOCK 256
+#endif
+
+#ifndef OPTIMIZE
+#define CARP_ARRAY_CHECK_NOT_EMPTY(a) assert((a)->len > 0)
+#define CARP_ARRAY_CHECK_SAME_LENGTH(a, b) assert((a)->len == (b)->len)
+#else
+#define CARP_ARRAY_CHECK_NOT_EMPTY(a)
+#define CARP_ARRAY_CHECK_SAME_LENGTH(a, b)
+#endif
+
+static inline int Array_internal_popcount(int bits) {
+    int n = 0;
+    for (; bits; bits &= bits - 1) {
+        n++;
+    }
+    return n;
+}
+
+#define CARP_ARRAY_VECTOR_KERNELS(P, E, V, N)                                 \
+    static inline V P##_internal_load(const E *p) {                           \
+        V v;                                                                  \
+        memcpy(&v, p, sizeof(V));                                             \
+        return v;                                                             \
+    }                                                                         \
+                                                                              \
+    static E P##_internal_pairwise(const E *p, size_t n) {                    \
+        if (n > CARP_ARRAY_PAIRWISE_BLOCK) {                                  \
+            size_t half = n / 2 / N * N;                                      \
+            return P##_internal_pairwise(p, half) +                           \
+                   P##_internal_pairwise(p + half, n - half);                 \
+        }                                                                     \
+        V acc0 = V##_splat(0);                                                \
+        V acc1 = V##_splat(0);                                                \
+        size_t i = 0;                                                         \
+        for (; i + 2 * N <= n; i += 2 * N) {                                  \
+            acc0 = V##_add(acc0, P##_internal_load(p + i));                   \
+            acc1 = V##_add(acc1, P##_internal_load(p + i + N));               \
+        }                                                                     \
+        E sum = V##_sum(V##_add(acc0, acc1));                                 \
+        for (; i < n; i++) {                                                  \
+            sum += p[i];                                                      \
+        }                                                                     \
+        return sum;                                                           \
+    }                                                                         \
+                                                                              \
+    E P##_array_MINUS_sum(Array *a) {                                         \
+        return P##_internal_pairwise(a->data, a->len);                        \
+    }                                                                         \
+                                                                              \
+    E P##_array_MINUS_minimum(Array *a) {                                     \
+        CARP_ARRAY_CHECK_NOT_EMPTY(a);                                        \
+        const E *p = a->data;                                                 \
+        size_t i = 0;                                                         \
+        E result = p[0];                                                      \
+        if (a->len >= N) {                                                    \
+            V m = P##_internal_load(p);                                       \
+            for (i = N; i + N <= a->len; i += N) {                            \
+                m = V##_min(m, P##_internal_load(p + i));                     \
+            }                                                                 \
+            result = V##_minimum(m);                                          \
+        }                                                                     \
+        for (; i < a->len; i++) {                                             \
+            result = p[i] < result ? p[i] : result;                           \
+        }                                                                     \
+        return result;                                                        \
+    }                                                                         \
+                                                                              \
+    E P##_array_MINUS_maximum(Array *a) {                                     \
+        CARP_ARRAY_CHECK_NOT_EMPTY(a);                                        \
+        const E *p = a->data;                                                 \
+        size_t i = 0;                                                         \
+        E result = p[0];                                                      \
+        if (a->len >= N) {                                                    \
+            V m = P##_internal_load(p);                                       \
+            for (i = N; i + N <= a->len; i += N) {                            \
+                m = V##_max(m, P##_internal_load(p + i));                     \
+            }                                                                 \
+            result = V##_maximum(m);                                          \
+        }                                                                     \
+        for (; i < a->len; i++) {                                             \
+            result = p[i] > result ? p[i] : result;                           \
+        }                                                                     \
+        return result;                                                        \
+    }                                                                         \
+                                                                              \
+    int P##_array_MINUS_element_MINUS_count(Array *a, E *e) {                 \
+        const E *p = a->data;                                                 \
+        V x = V##_splat(*e);                                                  \
+        size_t i = 0;                                                         \
+        int count = 0;                                                        \
+        for (; i + N <= a->len; i += N) {                                     \
+            count += Array_internal_popcount(                                 \
+                V##_eq_MINUS_mask(P##_internal_load(p + i), x));              \
+        }                                                                     \
+        for (; i < a->len; i++) {                                             \
+            count += p[i] == *e;                                              \
+        }                                                                     \
+        return count;                                                         \
+    }                                                                         \
+                                                                              \
+    E P##_array_MINUS_dot(Array *a, Array *b) {                               \
+        CARP_ARRAY_CHECK_SAME_LENGTH(a, b);                                   \
+        const E *p = a->data;                                                 \
+        const E *q = b->data;                                                 \
+        V acc0 = V##_splat(0);                                                \
+        V acc1 = V##_splat(0);                                                \
+        size_t i = 0;                                                         \
+        for (; i + 2 * N <= a->len; i += 2 * N) {                             \
+            acc0 = V##_add(acc0, V##_mul(P##_internal_load(p + i),            \
+                                         P##_internal_load(q + i)));          \
+            acc1 = V##_add(acc1, V##_mul(P##_internal_load(p + i + N),        \
+                                         P##_internal_load(q + i + N)));      \
+        }                                                                     \
+        E sum = V##_sum(V##_add(acc0, acc1));                                 \
+        for (; i < a->len; i++) {                                             \
+            sum += p[i] * q[i];                                               \
+        }                                                                     \
+        return sum;                                                           \
+    }                                                                         \
+                                                                              \
+    void P##_array_MINUS_axpy_BANG_(E alpha, Array *x, Array *y) {            \
+        CARP_ARRAY_CHECK_SAME_LENGTH(x, y);                                   \
+        const E *p = x->data;                                                 \
+        E *q = y->data;                                                       \
+        V va = V##_splat(alpha);                                              \
+        size_t i = 0;                                                         \
+        for (; i + N <= y->len; i += N) {                                     \
+            V r = V##_add(P##_internal_load(q + i),                           \
+                          V##_mul(va, P##_internal_load(p + i)));             \
+            memcpy(q + i, &r, sizeof(V));                                     \
+        }                                                                     \
+        for (; i < y->len; i++) {                                             \
+            q[i] += alpha * p[i];                                             \
+        }                                                                     \
+    }                                                                         \
+                                                                              \
+    /* A scan is sequential; the compiler does better with the plain loop    \
+     * than with shuffles across lanes. */                                    \
+    Array P##_array_MINUS_prefix_MINUS_sum(Array *a) {                        \
+        Array r;                                                              \
+        r.len = a->len;                                                       \
+        r.capacity = a->len;                                                  \
+        r.data = CARP_MALLOC(a->len * sizeof(E));                             \
+        const E *p = a->data;                                                 \
+        E *q = r.data;                                                        \
+        E sum = 0;                                                            \
+        for (size_t i = 0; i < a->len; i++) {                                 \
+            sum += p[i];                                                      \
+            q[i] = sum;                                                       \
+        }                                                                     \
+        return r;                                                             \
+    }
+
+CARP_ARRAY_VECTOR_KERNELS(IntArray, int, I32x8, 8)
+CARP_ARRAY_VECTOR_KERNELS(FloatArray, float, F32x4, 4)
+CARP_ARRAY_VECTOR_KERNELS(DoubleArray, double, F64x4, 4)
+
+long LongArray_array_MINUS_sum(Array *a) {
+    const long *p = a->data;
+    long s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= a->len; i += 4) {
+        s0 += p[i];
+        s1 += p[i + 1];
+        s2 += p[i + 2];
+        s3 += p[i + 3];
+    }
+    for (; i < a->len; i++) {
+        s0 += p[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+long LongArray_array_MINUS_minimum(Array *a) {
+    CARP_ARRAY_CHECK_NOT_EMPTY(a);
+    const long *p = a->data;
+    long result = p[0];
+    for (size_t i = 1; i < a->len; i++) {
+        result = p[i] < result ? p[i] : result;
+    }
+    return result;
+}
+
+long LongArray_array_MINUS_maximum(Array *a) {
+    CARP_ARRAY_CHECK_NOT_EMPTY(a);
+    const long *p = a->data;
+    long result = p[0];
+    for (size_t i = 1; i < a->len; i++) {
+        result = p[i] > result ? p[i] : result;
+    }
+    return result;
+}
+
+int LongArray_array_MINUS_element_MINUS_count(Array *a, long *e) {
+    const long *p = a->data;
+    int count = 0;
+    for (size_t i = 0; i < a->len; i++) {
+        count += p[i] == *e;
+    }
+    return count;
+}
+
+long LongArray_array_MINUS_dot(Array *a, Array *b) {
+    CARP_ARRAY_CHECK_SAME_LENGTH(a, b);
+    const long *p = a->data;
+    const long *q = b->data;
+    long s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= a->len; i += 4) {
+        s0 += p[i] * q[i];
+        s1 += p[i + 1] * q[i + 1];
+        s2 += p[i + 2] * q[i + 2];
+        s3 += p[i + 3] * q[i + 3];
+    }
+    for (; i < a->len; i++) {
+        s0 += p[i] * q[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+void LongArray_array_MINUS_axpy_BANG_(long alpha, Array *x, Array *y) {
+    CARP_ARRAY_CHECK_SAME_LENGTH(x, y);
+    const long *p = x->data;
+    long *q = y->data;
+    for (size_t i = 0; i < y->len; i++) {
+        q[i] += alpha * p[i];
+    }
+}
+
+Array LongArray_array_MINUS_prefix_MINUS_sum(Array *a) {
+    Array r;
+    r.len = a->len;
+    r.capacity = a->len;
+    r.data = CARP_MALLOC(a->len * sizeof(long));
+    const long *p = a->data;
+    long *q = r.data;
+    long sum = 0;
+    for (size_t i = 0; i < a->len; i++) {
+        sum += p[i];
+        q[i] = sum;
+    }
+    return r;
+}
+
+/* The corrected two-pass sum of squares for the variance: the sum of the
+ * squared deviations from `mean`, minus the square of their sum over n,
+ * which cancels most of the error in `mean` itself. Both sums are taken in
+ * the same pass. */
+double DoubleArray_squared_MINUS_deviations(Array *a, double mean) {
+    const double *p = a->data;
+    F64x4 m = F64x4_splat(mean);
+    F64x4 d = F64x4_splat(0);
+    F64x4 d2 = F64x4_splat(0);
+    size_t i = 0;
+    for (; i + 4 <= a->len; i += 4) {
+        F64x4 x = F64x4_sub(DoubleArray_internal_load(p + i), m);
+        d = F64x4_add(d, x);
+        d2 = F64x4_add(d2, F64x4_mul(x, x));
+    }
+    double sum = F64x4_sum(d);
+    double squares = F64x4_sum(d2);
+    for (; i < a->len; i++) {
+        double x = p[i] - mean;
+        sum += x;
+        squares += x * x;
+    }
+    return a->len ? squares - sum * sum / (double)a->len : 0.0;
+}
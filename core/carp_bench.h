@@ -1,7 +1,163 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <carp_memory.h>
+#include <core.h>
+
+/* Benchmarks measure intervals, so they use a monotonic clock that NTP can
+ * neither step nor (with CLOCK_MONOTONIC_RAW) slew. */
+#if defined(CLOCK_MONOTONIC_RAW)
+#define CARP_BENCH_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define CARP_BENCH_CLOCK CLOCK_MONOTONIC
+#endif
+
 double get_MINUS_time_MINUS_elapsed() {
   struct timespec tv;
-  clock_gettime(CLOCK_REALTIME, &tv);
-  return 1000000000 * tv.tv_sec + tv.tv_nsec;
+  clock_gettime(CARP_BENCH_CLOCK, &tv);
+  return 1000000000.0 * tv.tv_sec + tv.tv_nsec;
+}
+
+String Bench_internal_env(String *name, String *fallback) {
+    char *value = getenv(*name);
+    String s = value ? value : *fallback;
+    size_t len = strlen(s) + 1;
+    return (String) memcpy(CARP_MALLOC(len), s, len);
+}
+
+double Bench_internal_env_MINUS_double(String *name, double fallback) {
+    char *value = getenv(*name);
+    char *end = NULL;
+    if (!value) {
+        return fallback;
+    }
+    double d = strtod(value, &end);
+    return end == value ? fallback : d;
+}
+
+/* Appends `line` to the file at `path`, writing `header` first if the file
+ * is new or empty. */
+bool Bench_internal_append_MINUS_line(String *path, String *header, String *line) {
+    FILE *f = fopen(*path, "a");
+    if (!f) {
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0 && **header != '\0') {
+        fprintf(f, "%s\n", *header);
+    }
+    fprintf(f, "%s\n", *line);
+    return fclose(f) == 0;
+}
+
+/* Looks up the median of the benchmark `name` in a CSV file written by
+ * `Bench.run` (name in the first column, median in the fourth). Returns -1
+ * if the file or the benchmark is missing. */
+double Bench_internal_baseline_MINUS_median(String *path, String *name) {
+    FILE *f = fopen(*path, "r");
+    if (!f) {
+        return -1.0;
+    }
+    char line[1024];
+    size_t name_len = strlen(*name);
+    double median = -1.0;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, *name, name_len) != 0 || line[name_len] != ',') {
+            continue;
+        }
+        char *field = line + name_len + 1;
+        for (int column = 1; column < 3 && field; column++) {
+            field = strchr(field, ',');
+            if (field) field++;
+        }
+        if (field) {
+            median = strtod(field, NULL);
+        }
+    }
+    fclose(f);
+    return median;
+}
+
+/* Hardware and software event counters, read with perf_event_open on Linux.
+ * Every counter is opened on its own, so a kernel or container that refuses
+ * some of them (perf_event_paranoid, missing PMU in a VM) leaves just those
+ * unavailable. Only user space is counted, which unprivileged processes are
+ * usually allowed to do. */
+
+#define CARP_BENCH_COUNTERS 5
+
+int Bench_internal_counter_fds[CARP_BENCH_COUNTERS] = {-1, -1, -1, -1, -1};
+bool Bench_internal_counters_opened = false;
+
+#ifdef __linux__
+int Bench_internal_open_counter(unsigned int type, unsigned long long config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+void Bench_internal_counters_MINUS_start() {
+#ifdef __linux__
+    if (!Bench_internal_counters_opened) {
+        Bench_internal_counter_fds[0] = Bench_internal_open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        Bench_internal_counter_fds[1] = Bench_internal_open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        Bench_internal_counter_fds[2] = Bench_internal_open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        Bench_internal_counter_fds[3] = Bench_internal_open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        Bench_internal_counter_fds[4] = Bench_internal_open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+        Bench_internal_counters_opened = true;
+    }
+    for (int i = 0; i < CARP_BENCH_COUNTERS; i++) {
+        if (Bench_internal_counter_fds[i] >= 0) {
+            ioctl(Bench_internal_counter_fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(Bench_internal_counter_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void Bench_internal_counters_MINUS_stop() {
+#ifdef __linux__
+    for (int i = 0; i < CARP_BENCH_COUNTERS; i++) {
+        if (Bench_internal_counter_fds[i] >= 0) {
+            ioctl(Bench_internal_counter_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+}
+
+/* The count since the last start, scaled up if the kernel had to multiplex
+ * the counter with others. Returns -1 if the counter is unavailable. */
+double Bench_internal_counter(int index) {
+#ifdef __linux__
+    struct {
+        unsigned long long value;
+        unsigned long long time_enabled;
+        unsigned long long time_running;
+    } data;
+    int fd = index >= 0 && index < CARP_BENCH_COUNTERS ? Bench_internal_counter_fds[index] : -1;
+    if (fd < 0 || read(fd, &data, sizeof(data)) != sizeof(data) || data.time_running == 0) {
+        return -1.0;
+    }
+    return (double)data.value * ((double)data.time_enabled / (double)data.time_running);
+#else
+    return -1.0;
+#endif
 }
@@ -0,0 +1,217 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <carp_memory.h>
+#include <core.h>
+
+/* Binary buffers are plain `(Array Char)`s. Unlike `String` they carry their
+ * own length, so zero bytes are just data. All accessors take the array and a
+ * pointer to the cursor, read or write at the cursor, and advance it. */
+
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#define CARP_BSWAP16(x) _byteswap_ushort(x)
+#define CARP_BSWAP32(x) _byteswap_ulong(x)
+#define CARP_BSWAP64(x) _byteswap_uint64(x)
+#else
+#define CARP_BSWAP16(x) __builtin_bswap16(x)
+#define CARP_BSWAP32(x) __builtin_bswap32(x)
+#define CARP_BSWAP64(x) __builtin_bswap64(x)
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define CARP_HOST_BIG_ENDIAN true
+#else
+#define CARP_HOST_BIG_ENDIAN false
+#endif
+
+#define CARP_VARINT_MAX_BYTES 10
+
+unsigned char *Bytes_internal_at(Array *a, int *cursor, int width) {
+#ifndef OPTIMIZE
+    assert(*cursor >= 0);
+    assert(*cursor + width <= (int)a->len);
+#endif
+    unsigned char *p = (unsigned char*)a->data + *cursor;
+    *cursor += width;
+    return p;
+}
+
+/* Grows the array so that `width` bytes fit at the cursor. Any gap between
+ * the old end and the cursor is zeroed. */
+unsigned char *Bytes_internal_reserve(Array *a, int *cursor, int width) {
+#ifndef OPTIMIZE
+    assert(*cursor >= 0);
+#endif
+    size_t end = (size_t)*cursor + width;
+    if (end > a->len) {
+        if (end > a->capacity) {
+            size_t capacity = a->capacity * 2;
+            if (capacity < end) capacity = end;
+            a->data = CARP_REALLOC(a->data, capacity);
+            a->capacity = capacity;
+        }
+        if ((size_t)*cursor > a->len) {
+            memset((char*)a->data + a->len, 0, *cursor - a->len);
+        }
+        a->len = end;
+    }
+    unsigned char *p = (unsigned char*)a->data + *cursor;
+    *cursor += width;
+    return p;
+}
+
+int Bytes_internal_load_MINUS_u8(Array *a, int *cursor) {
+    return *Bytes_internal_at(a, cursor, 1);
+}
+
+int Bytes_internal_load_MINUS_i8(Array *a, int *cursor) {
+    return (int8_t)*Bytes_internal_at(a, cursor, 1);
+}
+
+uint16_t Bytes_internal_load16(Array *a, int *cursor, bool big_endian) {
+    uint16_t v;
+    memcpy(&v, Bytes_internal_at(a, cursor, sizeof(v)), sizeof(v));
+    return big_endian == CARP_HOST_BIG_ENDIAN ? v : CARP_BSWAP16(v);
+}
+
+uint32_t Bytes_internal_load32(Array *a, int *cursor, bool big_endian) {
+    uint32_t v;
+    memcpy(&v, Bytes_internal_at(a, cursor, sizeof(v)), sizeof(v));
+    return big_endian == CARP_HOST_BIG_ENDIAN ? v : CARP_BSWAP32(v);
+}
+
+uint64_t Bytes_internal_load64(Array *a, int *cursor, bool big_endian) {
+    uint64_t v;
+    memcpy(&v, Bytes_internal_at(a, cursor, sizeof(v)), sizeof(v));
+    return big_endian == CARP_HOST_BIG_ENDIAN ? v : CARP_BSWAP64(v);
+}
+
+int Bytes_internal_load_MINUS_u16(Array *a, int *cursor, bool big_endian) {
+    return Bytes_internal_load16(a, cursor, big_endian);
+}
+
+int Bytes_internal_load_MINUS_i16(Array *a, int *cursor, bool big_endian) {
+    return (int16_t)Bytes_internal_load16(a, cursor, big_endian);
+}
+
+long Bytes_internal_load_MINUS_u32(Array *a, int *cursor, bool big_endian) {
+    return Bytes_internal_load32(a, cursor, big_endian);
+}
+
+int Bytes_internal_load_MINUS_i32(Array *a, int *cursor, bool big_endian) {
+    return (int32_t)Bytes_internal_load32(a, cursor, big_endian);
+}
+
+long Bytes_internal_load_MINUS_u64(Array *a, int *cursor, bool big_endian) {
+    return (long)Bytes_internal_load64(a, cursor, big_endian);
+}
+
+float Bytes_internal_load_MINUS_f32(Array *a, int *cursor, bool big_endian) {
+    uint32_t bits = Bytes_internal_load32(a, cursor, big_endian);
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+double Bytes_internal_load_MINUS_f64(Array *a, int *cursor, bool big_endian) {
+    uint64_t bits = Bytes_internal_load64(a, cursor, big_endian);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+/* Unsigned LEB128, as used by protobuf and most binary log formats. */
+long Bytes_internal_load_MINUS_varint(Array *a, int *cursor) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 7 * CARP_VARINT_MAX_BYTES; shift += 7) {
+        unsigned char byte = *Bytes_internal_at(a, cursor, 1);
+        v |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    return (long)v;
+}
+
+/* Zigzag-encoded signed LEB128, so small negative numbers stay short. */
+long Bytes_internal_load_MINUS_svarint(Array *a, int *cursor) {
+    uint64_t u = (uint64_t)Bytes_internal_load_MINUS_varint(a, cursor);
+    return (long)((u >> 1) ^ (~(u & 1) + 1));
+}
+
+void Bytes_internal_store_MINUS_u8(Array *a, int *cursor, int v) {
+    *Bytes_internal_reserve(a, cursor, 1) = (unsigned char)v;
+}
+
+void Bytes_internal_store_MINUS_u16(Array *a, int *cursor, bool big_endian, int v) {
+    uint16_t bits = big_endian == CARP_HOST_BIG_ENDIAN ? (uint16_t)v : CARP_BSWAP16((uint16_t)v);
+    memcpy(Bytes_internal_reserve(a, cursor, sizeof(bits)), &bits, sizeof(bits));
+}
+
+void Bytes_internal_store_MINUS_u32(Array *a, int *cursor, bool big_endian, long v) {
+    uint32_t bits = big_endian == CARP_HOST_BIG_ENDIAN ? (uint32_t)v : CARP_BSWAP32((uint32_t)v);
+    memcpy(Bytes_internal_reserve(a, cursor, sizeof(bits)), &bits, sizeof(bits));
+}
+
+void Bytes_internal_store_MINUS_u64(Array *a, int *cursor, bool big_endian, long v) {
+    uint64_t bits = big_endian == CARP_HOST_BIG_ENDIAN ? (uint64_t)v : CARP_BSWAP64((uint64_t)v);
+    memcpy(Bytes_internal_reserve(a, cursor, sizeof(bits)), &bits, sizeof(bits));
+}
+
+void Bytes_internal_store_MINUS_f32(Array *a, int *cursor, bool big_endian, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    Bytes_internal_store_MINUS_u32(a, cursor, big_endian, bits);
+}
+
+void Bytes_internal_store_MINUS_f64(Array *a, int *cursor, bool big_endian, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    Bytes_internal_store_MINUS_u64(a, cursor, big_endian, (long)bits);
+}
+
+void Bytes_internal_store_MINUS_varint(Array *a, int *cursor, long v) {
+    uint64_t u = (uint64_t)v;
+    while (u >= 0x80) {
+        *Bytes_internal_reserve(a, cursor, 1) = (unsigned char)(u | 0x80);
+        u >>= 7;
+    }
+    *Bytes_internal_reserve(a, cursor, 1) = (unsigned char)u;
+}
+
+void Bytes_internal_store_MINUS_svarint(Array *a, int *cursor, long v) {
+    uint64_t u = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+    Bytes_internal_store_MINUS_varint(a, cursor, (long)u);
+}
+
+Array Bytes_internal_read_MINUS_file(String *filename) {
+    Array a;
+    long length = 0;
+    FILE *f = fopen(*filename, "rb");
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        length = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        if (length < 0) length = 0;
+    } else {
+        printf("Failed to open file: %s\n", *filename);
+    }
+    a.data = CARP_MALLOC(length);
+    a.capacity = length;
+    a.len = f ? fread(a.data, 1, length, f) : 0;
+    if (f) fclose(f);
+    return a;
+}
+
+bool Bytes_internal_write_MINUS_file(String *filename, Array *a) {
+    FILE *f = fopen(*filename, "wb");
+    if (!f) {
+        return false;
+    }
+    size_t written = fwrite(a->data, 1, a->len, f);
+    bool closed = fclose(f) == 0;
+    return closed && written == a->len;
+}
@@ -0,0 +1,654 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <carp_memory.h>
+#include <core.h>
+
+/* Formatting into a buffer, for `fmt` and `fmt-into`. A buffer is an
+ * (Array Char), so it can be grown, reused and inspected with the Array
+ * functions; `Format.to-string` terminates it and hands its memory over as
+ * a String, without copying unless it is completely full.
+ *
+ * The `format-into` functions write the most common conversions directly:
+ * %d and %i for Int, %ld and %li for Long, %s, %c, and %f and %.Nf for
+ * Float and Double. Everything else, and fixed-point values that are too
+ * large or too close to a rounding tie to be sure of the last digit, goes
+ * through snprintf straight into the buffer. */
+
+static const char Format_internal_digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Writes the decimal digits of v to out, two at a time, and returns how
+ * many were written (at most 20). */
+static inline int Format_internal_write_u64(char *out, uint64_t v) {
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    while (v >= 100) {
+        const char *pair = Format_internal_digit_pairs + (v % 100) * 2;
+        v /= 100;
+        p -= 2;
+        p[0] = pair[0];
+        p[1] = pair[1];
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, Format_internal_digit_pairs + v * 2, 2);
+    } else {
+        *--p = (char)('0' + v);
+    }
+    int n = (int)(tmp + sizeof(tmp) - p);
+    memcpy(out, p, n);
+    return n;
+}
+
+static inline int Format_internal_write_i64(char *out, int64_t v) {
+    if (v < 0) {
+        *out = '-';
+        return 1 + Format_internal_write_u64(out + 1, 0 - (uint64_t)v);
+    }
+    return Format_internal_write_u64(out, (uint64_t)v);
+}
+
+/* Shortest round-trip digits of a double, after Loitsch's Grisu2 ("Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers", 2010): the
+ * value and the boundaries of the interval that rounds to it are scaled by
+ * a cached power of ten into a 64-bit fixed-point range, and digits are
+ * generated until the result lies inside that interval. The digits always
+ * read back as the same value, and are the shortest such digits in all but
+ * a small fraction of cases, where up to two digits more are produced
+ * (3975.3850732259298 where 3975.38507322593 reads back too). `bits` is
+ * the precision of the value's type (53 for Double, 24 for Float), so a
+ * Float gets the digits that identify it as a Float. */
+
+typedef struct {
+    uint64_t f;
+    int e;
+} Format_internal_fp;
+
+static inline Format_internal_fp Format_internal_fp_mul(Format_internal_fp x,
+                                                        Format_internal_fp y) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t p = (__uint128_t)x.f * y.f;
+    uint64_t h = (uint64_t)(p >> 64);
+    uint64_t l = (uint64_t)p;
+#else
+    uint64_t a = x.f >> 32, b = x.f & 0xffffffff;
+    uint64_t c = y.f >> 32, d = y.f & 0xffffffff;
+    uint64_t bd = b * d, ad = a * d, bc = b * c;
+    uint64_t mid = (bd >> 32) + (ad & 0xffffffff) + (bc & 0xffffffff);
+    uint64_t h = a * c + (ad >> 32) + (bc >> 32) + (mid >> 32);
+    uint64_t l = (mid << 32) | (bd & 0xffffffff);
+#endif
+    Format_internal_fp r = {h + (l >> 63), x.e + y.e + 64};
+    return r;
+}
+
+static inline Format_internal_fp Format_internal_fp_normalize(Format_internal_fp x) {
+    while ((x.f >> 63) == 0) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+/* 10^k for every eighth k, normalized: {f, e, k} with f * 2^e ~ 10^k. */
+static const struct {
+    uint64_t f;
+    int e;
+    int k;
+} Format_internal_cached_powers[] = {
+    {0xAB70FE17C79AC6CAULL, -1060, -300},
+    {0xFF77B1FCBEBCDC4FULL, -1034, -292},
+    {0xBE5691EF416BD60CULL, -1007, -284},
+    {0x8DD01FAD907FFC3CULL, -980, -276},
+    {0xD3515C2831559A83ULL, -954, -268},
+    {0x9D71AC8FADA6C9B5ULL, -927, -260},
+    {0xEA9C227723EE8BCBULL, -901, -252},
+    {0xAECC49914078536DULL, -874, -244},
+    {0x823C12795DB6CE57ULL, -847, -236},
+    {0xC21094364DFB5637ULL, -821, -228},
+    {0x9096EA6F3848984FULL, -794, -220},
+    {0xD77485CB25823AC7ULL, -768, -212},
+    {0xA086CFCD97BF97F4ULL, -741, -204},
+    {0xEF340A98172AACE5ULL, -715, -196},
+    {0xB23867FB2A35B28EULL, -688, -188},
+    {0x84C8D4DFD2C63F3BULL, -661, -180},
+    {0xC5DD44271AD3CDBAULL, -635, -172},
+    {0x936B9FCEBB25C996ULL, -608, -164},
+    {0xDBAC6C247D62A584ULL, -582, -156},
+    {0xA3AB66580D5FDAF6ULL, -555, -148},
+    {0xF3E2F893DEC3F126ULL, -529, -140},
+    {0xB5B5ADA8AAFF80B8ULL, -502, -132},
+    {0x87625F056C7C4A8BULL, -475, -124},
+    {0xC9BCFF6034C13053ULL, -449, -116},
+    {0x964E858C91BA2655ULL, -422, -108},
+    {0xDFF9772470297EBDULL, -396, -100},
+    {0xA6DFBD9FB8E5B88FULL, -369, -92},
+    {0xF8A95FCF88747D94ULL, -343, -84},
+    {0xB94470938FA89BCFULL, -316, -76},
+    {0x8A08F0F8BF0F156BULL, -289, -68},
+    {0xCDB02555653131B6ULL, -263, -60},
+    {0x993FE2C6D07B7FACULL, -236, -52},
+    {0xE45C10C42A2B3B06ULL, -210, -44},
+    {0xAA242499697392D3ULL, -183, -36},
+    {0xFD87B5F28300CA0EULL, -157, -28},
+    {0xBCE5086492111AEBULL, -130, -20},
+    {0x8CBCCC096F5088CCULL, -103, -12},
+    {0xD1B71758E219652CULL, -77, -4},
+    {0x9C40000000000000ULL, -50, 4},
+    {0xE8D4A51000000000ULL, -24, 12},
+    {0xAD78EBC5AC620000ULL, 3, 20},
+    {0x813F3978F8940984ULL, 30, 28},
+    {0xC097CE7BC90715B3ULL, 56, 36},
+    {0x8F7E32CE7BEA5C70ULL, 83, 44},
+    {0xD5D238A4ABE98068ULL, 109, 52},
+    {0x9F4F2726179A2245ULL, 136, 60},
+    {0xED63A231D4C4FB27ULL, 162, 68},
+    {0xB0DE65388CC8ADA8ULL, 189, 76},
+    {0x83C7088E1AAB65DBULL, 216, 84},
+    {0xC45D1DF942711D9AULL, 242, 92},
+    {0x924D692CA61BE758ULL, 269, 100},
+    {0xDA01EE641A708DEAULL, 295, 108},
+    {0xA26DA3999AEF774AULL, 322, 116},
+    {0xF209787BB47D6B85ULL, 348, 124},
+    {0xB454E4A179DD1877ULL, 375, 132},
+    {0x865B86925B9BC5C2ULL, 402, 140},
+    {0xC83553C5C8965D3DULL, 428, 148},
+    {0x952AB45CFA97A0B3ULL, 455, 156},
+    {0xDE469FBD99A05FE3ULL, 481, 164},
+    {0xA59BC234DB398C25ULL, 508, 172},
+    {0xF6C69A72A3989F5CULL, 534, 180},
+    {0xB7DCBF5354E9BECEULL, 561, 188},
+    {0x88FCF317F22241E2ULL, 588, 196},
+    {0xCC20CE9BD35C78A5ULL, 614, 204},
+    {0x98165AF37B2153DFULL, 641, 212},
+    {0xE2A0B5DC971F303AULL, 667, 220},
+    {0xA8D9D1535CE3B396ULL, 694, 228},
+    {0xFB9B7CD9A4A7443CULL, 720, 236},
+    {0xBB764C4CA7A44410ULL, 747, 244},
+    {0x8BAB8EEFB6409C1AULL, 774, 252},
+    {0xD01FEF10A657842CULL, 800, 260},
+    {0x9B10A4E5E9913129ULL, 827, 268},
+    {0xE7109BFBA19C0C9DULL, 853, 276},
+    {0xAC2820D9623BF429ULL, 880, 284},
+    {0x80444B5E7AA7CF85ULL, 907, 292},
+    {0xBF21E44003ACDD2DULL, 933, 300},
+    {0x8E679C2F5E44FF8FULL, 960, 308},
+    {0xD433179D9C8CB841ULL, 986, 316},
+    {0x9E19DB92B4E31BA9ULL, 1013, 324},
+};
+
+static void Format_internal_round_digit(char *digits, int len, uint64_t dist,
+                                        uint64_t delta, uint64_t rest,
+                                        uint64_t ten_k) {
+    while (rest < dist && delta - rest >= ten_k &&
+           (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+        digits[len - 1]--;
+        rest += ten_k;
+    }
+}
+
+/* Writes the digits of v > 0 to digits (at most 17) and sets *exponent so
+ * that v = digits * 10^exponent. Returns the number of digits. */
+static int Format_internal_shortest(double v, int bits, char *digits,
+                                    int *exponent) {
+    const int bias = (bits == 53 ? 1023 : 127) + bits - 1;
+    const uint64_t hidden = (uint64_t)1 << (bits - 1);
+    uint64_t raw;
+    if (bits == 53) {
+        memcpy(&raw, &v, sizeof(raw));
+    } else {
+        float x = (float)v;
+        uint32_t raw32;
+        memcpy(&raw32, &x, sizeof(raw32));
+        raw = raw32;
+    }
+    uint64_t biased = raw >> (bits - 1);
+    uint64_t fraction = raw & (hidden - 1);
+    Format_internal_fp w = biased == 0
+                               ? (Format_internal_fp){fraction, 1 - bias}
+                               : (Format_internal_fp){fraction + hidden, (int)biased - bias};
+
+    /* The boundaries halfway to the neighbouring values; the lower one is
+     * closer at a power of two. */
+    Format_internal_fp plus = {2 * w.f + 1, w.e - 1};
+    Format_internal_fp minus = fraction == 0 && biased > 1
+                                   ? (Format_internal_fp){4 * w.f - 1, w.e - 2}
+                                   : (Format_internal_fp){2 * w.f - 1, w.e - 1};
+    plus = Format_internal_fp_normalize(plus);
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+    w = Format_internal_fp_normalize(w);
+
+    /* A power of ten that brings the exponent into [-60, -32]. */
+    int f = -60 - plus.e - 1;
+    int k = (f * 78913) / (1 << 18) + (f > 0);
+    int index = (300 + k + 7) / 8;
+    Format_internal_fp c = {Format_internal_cached_powers[index].f,
+                            Format_internal_cached_powers[index].e};
+    *exponent = -Format_internal_cached_powers[index].k;
+
+    Format_internal_fp scaled = Format_internal_fp_mul(w, c);
+    Format_internal_fp low = Format_internal_fp_mul(minus, c);
+    Format_internal_fp high = Format_internal_fp_mul(plus, c);
+    low.f++;
+    high.f--;
+
+    uint64_t delta = high.f - low.f;
+    uint64_t dist = high.f - scaled.f;
+    int shift = -high.e;
+    uint64_t one = (uint64_t)1 << shift;
+    uint32_t p1 = (uint32_t)(high.f >> shift);
+    uint64_t p2 = high.f & (one - 1);
+
+    uint32_t pow10 = 1;
+    int n = 1;
+    while (n < 10 && p1 >= pow10 * 10) {
+        pow10 *= 10;
+        n++;
+    }
+
+    int len = 0;
+    while (n > 0) {
+        digits[len++] = (char)('0' + p1 / pow10);
+        p1 %= pow10;
+        n--;
+        uint64_t rest = ((uint64_t)p1 << shift) + p2;
+        if (rest <= delta) {
+            *exponent += n;
+            Format_internal_round_digit(digits, len, dist, delta, rest,
+                                        (uint64_t)pow10 << shift);
+            return len;
+        }
+        pow10 /= 10;
+    }
+    int m = 0;
+    for (;;) {
+        p2 *= 10;
+        digits[len++] = (char)('0' + (p2 >> shift));
+        p2 &= one - 1;
+        m++;
+        delta *= 10;
+        dist *= 10;
+        if (p2 <= delta) {
+            break;
+        }
+    }
+    *exponent -= m;
+    Format_internal_round_digit(digits, len, dist, delta, p2, one);
+    return len;
+}
+
+/* Writes x like %g would with just enough precision to read back as the
+ * same value, but at least the default of 6: fixed notation unless the
+ * exponent is below -4 or not below that precision, no trailing zeros.
+ * Subnormals have fewer significant digits than %g gives them: 5.64e-321
+ * rather than 5.64223e-321, which reads back the same. Returns the length (at most 25), or -1 for infinities and NaN. */
+static int Format_internal_write_general(char *out, double x, int bits) {
+    if (!isfinite(x)) {
+        return -1;
+    }
+    char *p = out;
+    if (signbit(x)) {
+        *p++ = '-';
+        x = -x;
+    }
+    if (x == 0.0) {
+        *p++ = '0';
+        return (int)(p - out);
+    }
+    char digits[20];
+    int exponent;
+    int n = Format_internal_shortest(x, bits, digits, &exponent);
+    while (n > 1 && digits[n - 1] == '0') {
+        n--;
+        exponent++;
+    }
+    int point = exponent + n - 1; /* the exponent of the first digit */
+    int precision = n > 6 ? n : 6;
+    if (point < -4 || point >= precision) {
+        *p++ = digits[0];
+        if (n > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, n - 1);
+            p += n - 1;
+        }
+        *p++ = 'e';
+        *p++ = point < 0 ? '-' : '+';
+        int e = point < 0 ? -point : point;
+        if (e >= 100) {
+            *p++ = (char)('0' + e / 100);
+            e %= 100;
+        }
+        memcpy(p, Format_internal_digit_pairs + e * 2, 2);
+        p += 2;
+    } else if (point < 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -point - 1);
+        p += -point - 1;
+        memcpy(p, digits, n);
+        p += n;
+    } else if (point + 1 >= n) {
+        memcpy(p, digits, n);
+        p += n;
+        memset(p, '0', point + 1 - n);
+        p += point + 1 - n;
+    } else {
+        memcpy(p, digits, point + 1);
+        p += point + 1;
+        *p++ = '.';
+        memcpy(p, digits + point + 1, n - point - 1);
+        p += n - point - 1;
+    }
+    return (int)(p - out);
+}
+
+Array Format_buffer(int n) {
+    Array b;
+    b.len = 0;
+    b.capacity = n > 0 ? n : 0;
+    b.data = CARP_MALLOC(b.capacity ? b.capacity : 1);
+    return b;
+}
+
+/* Makes room for n more bytes, at least doubling the capacity. */
+void Format_reserve_BANG_(Array *b, int n) {
+    size_t needed = b->len + (n > 0 ? n : 0);
+    if (needed <= b->capacity) {
+        return;
+    }
+    size_t capacity = b->capacity * 2;
+    if (capacity < needed) {
+        capacity = needed;
+    }
+    b->data = CARP_REALLOC(b->data, capacity);
+    b->capacity = capacity;
+}
+
+static inline char *Format_internal_end(Array *b) {
+    return (char *)b->data + b->len;
+}
+
+static inline void Format_internal_append(Array *b, const char *s, size_t n) {
+    Format_reserve_BANG_(b, (int)n);
+    memcpy(Format_internal_end(b), s, n);
+    b->len += n;
+}
+
+void Format_append_BANG_(Array *b, String *s) {
+    Format_internal_append(b, *s, strlen(*s));
+}
+
+String Format_to_MINUS_string(Array b) {
+    if (b.len == b.capacity) {
+        b.data = CARP_REALLOC(b.data, b.len + 1);
+    }
+    ((char *)b.data)[b.len] = '\0';
+    return b.data;
+}
+
+/* snprintf into the free end of the buffer, and once more if that was too
+ * small. */
+#define CARP_FORMAT_SNPRINTF(b, spec, x)                                     \
+    do {                                                                     \
+        Format_reserve_BANG_((b), 32);                                       \
+        size_t available = (b)->capacity - (b)->len;                         \
+        int n = snprintf(Format_internal_end(b), available, (spec), (x));    \
+        if (n < 0) {                                                         \
+            break;                                                           \
+        }                                                                    \
+        if ((size_t)n >= available) {                                        \
+            Format_reserve_BANG_((b), n + 1);                                \
+            snprintf(Format_internal_end(b), n + 1, (spec), (x));            \
+        }                                                                    \
+        (b)->len += n;                                                       \
+    } while (0)
+
+static const double Format_internal_powers_of_ten[10] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+/* The precision of a spec of the form %f or %.Nf with N below 10, or -1. */
+static int Format_internal_fixed_precision(const char *spec) {
+    if (strcmp(spec, "%f") == 0) {
+        return 6;
+    }
+    if (spec[0] == '%' && spec[1] == '.' && spec[2] >= '0' && spec[2] <= '9' &&
+        spec[3] == 'f' && spec[4] == '\0') {
+        return spec[2] - '0';
+    }
+    return -1;
+}
+
+/* %.Nf without snprintf: x scaled by 10^N is rounded to an integer, which
+ * is exact as long as it stays below 2^53 and isn't within the rounding
+ * error of the multiplication from a tie. Returns false if it couldn't. */
+static bool Format_internal_fixed(Array *b, double x, int precision) {
+    if (!isfinite(x)) {
+        return false;
+    }
+    double scaled = fabs(x) * Format_internal_powers_of_ten[precision];
+    if (scaled >= 9007199254740992.0) {
+        return false;
+    }
+    double fraction = scaled - floor(scaled);
+    if (fabs(fraction - 0.5) <= 4.0 * scaled * 2.220446049250313e-16) {
+        return false;
+    }
+    uint64_t digits = (uint64_t)nearbyint(scaled);
+    uint64_t unit = (uint64_t)Format_internal_powers_of_ten[precision];
+    Format_reserve_BANG_(b, 32);
+    char *p = Format_internal_end(b);
+    char *start = p;
+    if (signbit(x)) {
+        *p++ = '-';
+    }
+    p += Format_internal_write_u64(p, digits / unit);
+    if (precision > 0) {
+        char tmp[20];
+        int n = Format_internal_write_u64(tmp, digits % unit);
+        *p++ = '.';
+        memset(p, '0', precision - n);
+        memcpy(p + precision - n, tmp, n);
+        p += precision;
+    }
+    b->len += p - start;
+    return true;
+}
+
+void Int_format_MINUS_into(Array *b, String *spec, int x) {
+    if (strcmp(*spec, "%d") == 0 || strcmp(*spec, "%i") == 0) {
+        Format_reserve_BANG_(b, 11);
+        b->len += Format_internal_write_i64(Format_internal_end(b), x);
+    } else {
+        CARP_FORMAT_SNPRINTF(b, *spec, x);
+    }
+}
+
+void Long_format_MINUS_into(Array *b, String *spec, long x) {
+    if (strcmp(*spec, "%ld") == 0 || strcmp(*spec, "%li") == 0) {
+        Format_reserve_BANG_(b, 20);
+        b->len += Format_internal_write_i64(Format_internal_end(b), x);
+    } else {
+        CARP_FORMAT_SNPRINTF(b, *spec, x);
+    }
+}
+
+void Double_format_MINUS_into(Array *b, String *spec, double x) {
+    int precision = Format_internal_fixed_precision(*spec);
+    if (precision < 0 || !Format_internal_fixed(b, x, precision)) {
+        CARP_FORMAT_SNPRINTF(b, *spec, x);
+    }
+}
+
+void Float_format_MINUS_into(Array *b, String *spec, float x) {
+    Double_format_MINUS_into(b, spec, x);
+}
+
+void Char_format_MINUS_into(Array *b, String *spec, char x) {
+    if (strcmp(*spec, "%c") == 0) {
+        Format_internal_append(b, &x, 1);
+    } else {
+        CARP_FORMAT_SNPRINTF(b, *spec, x);
+    }
+}
+
+void Bool_format_MINUS_into(Array *b, String *spec, bool x) {
+    CARP_FORMAT_SNPRINTF(b, *spec, x);
+}
+
+void String_format_MINUS_into(Array *b, String *spec, String *s) {
+    if (strcmp(*spec, "%s") == 0) {
+        Format_internal_append(b, *s, strlen(*s));
+    } else {
+        CARP_FORMAT_SNPRINTF(b, *spec, *s);
+    }
+}
+
+/* The `format-size` functions tell `fmt` how much room a conversion takes:
+ * exactly for %s, and for the rest at least what the common cases need,
+ * given the width and precision in the spec. A conversion that turns out
+ * longer only makes the buffer grow. */
+
+typedef struct {
+    int width;
+    int precision;
+    char conversion;
+} Format_internal_spec;
+
+static Format_internal_spec Format_internal_parse_spec(const char *spec) {
+    Format_internal_spec result = {0, -1, '\0'};
+    const char *p = spec + 1;
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL) {
+        p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+        result.width = result.width * 10 + (*p++ - '0');
+    }
+    if (*p == '.') {
+        p++;
+        result.precision = 0;
+        while (*p >= '0' && *p <= '9') {
+            result.precision = result.precision * 10 + (*p++ - '0');
+        }
+    }
+    while (*p != '\0' && p[1] != '\0') {
+        p++;
+    }
+    result.conversion = *p;
+    return result;
+}
+
+static inline int Format_internal_at_least(Format_internal_spec spec, int n) {
+    return n < spec.width ? spec.width : n;
+}
+
+int Int_format_MINUS_size(String *spec, int x) {
+    return Format_internal_at_least(Format_internal_parse_spec(*spec), 11);
+}
+
+int Long_format_MINUS_size(String *spec, long x) {
+    return Format_internal_at_least(Format_internal_parse_spec(*spec), 22);
+}
+
+int Double_format_MINUS_size(String *spec, double x) {
+    Format_internal_spec s = Format_internal_parse_spec(*spec);
+    int precision = s.precision < 0 ? 6 : s.precision;
+    if ((s.conversion == 'f' || s.conversion == 'F') && isfinite(x)) {
+        /* a sign, the integer digits, a point and the fraction */
+        double magnitude = fabs(x);
+        int digits = magnitude < 10.0 ? 1 : 1 + (int)log10(magnitude);
+        return Format_internal_at_least(s, digits + precision + 2);
+    }
+    /* a sign, a digit, a point, the fraction and an exponent like e+308 */
+    return Format_internal_at_least(s, precision + 8);
+}
+
+int Float_format_MINUS_size(String *spec, float x) {
+    return Double_format_MINUS_size(spec, x);
+}
+
+int Char_format_MINUS_size(String *spec, char x) {
+    return Format_internal_at_least(Format_internal_parse_spec(*spec), 4);
+}
+
+int Bool_format_MINUS_size(String *spec, bool x) {
+    return Format_internal_at_least(Format_internal_parse_spec(*spec), 5);
+}
+
+int String_format_MINUS_size(String *spec, String *s) {
+    int len = (int)strlen(*s);
+    if (strcmp(*spec, "%s") == 0) {
+        return len;
+    }
+    Format_internal_spec parsed = Format_internal_parse_spec(*spec);
+    if (parsed.precision >= 0 && parsed.precision < len) {
+        len = parsed.precision;
+    }
+    return Format_internal_at_least(parsed, len);
+}
+
+/* The `str-into` functions append what `str` returns. */
+
+void Int_str_MINUS_into(Array *b, int x) {
+    Format_reserve_BANG_(b, 11);
+    b->len += Format_internal_write_i64(Format_internal_end(b), x);
+}
+
+void Long_str_MINUS_into(Array *b, long x) {
+    Format_reserve_BANG_(b, 21);
+    char *end = Format_internal_end(b);
+    int n = Format_internal_write_i64(end, x);
+    end[n] = 'l';
+    b->len += n + 1;
+}
+
+void Double_str_MINUS_into(Array *b, double x) {
+    Format_reserve_BANG_(b, 32);
+    int n = Format_internal_write_general(Format_internal_end(b), x, 53);
+    if (n < 0) {
+        CARP_FORMAT_SNPRINTF(b, "%g", x);
+    } else {
+        b->len += n;
+    }
+}
+
+void Float_str_MINUS_into(Array *b, float x) {
+    Format_reserve_BANG_(b, 32);
+    char *end = Format_internal_end(b);
+    int n = Format_internal_write_general(end, x, 24);
+    if (n < 0) {
+        CARP_FORMAT_SNPRINTF(b, "%gf", x);
+    } else {
+        end[n] = 'f';
+        b->len += n + 1;
+    }
+}
+
+void Bool_str_MINUS_into(Array *b, bool x) {
+    if (x) {
+        Format_internal_append(b, "true", 4);
+    } else {
+        Format_internal_append(b, "false", 5);
+    }
+}
+
+void Char_str_MINUS_into(Array *b, char x) {
+    Format_internal_append(b, &x, 1);
+}
+
+void String_str_MINUS_into(Array *b, String *s) {
+    Format_internal_append(b, *s, strlen(*s));
+}
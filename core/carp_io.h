@@ -1,5 +1,19 @@
 #pragma once
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
 
 #include <carp_string.h>
 
@@ -108,3 +122,231 @@ void IO_fclose(FILE *f) {
 FILE *IO_fopen(String *filename, String *mode) {
     return fopen(*filename, *mode);
 }
+
+/* Transfer between file descriptors.
+ *
+ * On Linux the bytes never enter user space if the kernel can help it: we try
+ * copy_file_range (file to file), then sendfile (anything to file or socket),
+ * then splice through a pipe (sockets and pipes as input). Whatever is left
+ * over after a primitive refuses the descriptors is moved through a plain
+ * read/write loop, which is also the only strategy on other platforms.
+ */
+
+#define CARP_IO_TRANSFER_BUFFER_SIZE (64 * 1024)
+#define CARP_IO_TRANSFER_MAX_CHUNK (1L << 30)
+
+#ifdef _WIN32
+#define IO_internal_read _read
+#define IO_internal_write _write
+#else
+#define IO_internal_read read
+#define IO_internal_write write
+#endif
+
+long IO_internal_chunk(long count, long total) {
+    if (count < 0 || count - total > CARP_IO_TRANSFER_MAX_CHUNK) {
+        return CARP_IO_TRANSFER_MAX_CHUNK;
+    }
+    return count - total;
+}
+
+bool IO_internal_write_all(int out_fd, char *buffer, long len) {
+    while (len > 0) {
+        long n = IO_internal_write(out_fd, buffer, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        buffer += n;
+        len -= n;
+    }
+    return true;
+}
+
+long IO_internal_transfer_buffered(int out_fd, int in_fd, long count) {
+    char buffer[CARP_IO_TRANSFER_BUFFER_SIZE];
+    long total = 0;
+    while (count < 0 || total < count) {
+        long want = IO_internal_chunk(count, total);
+        if (want > CARP_IO_TRANSFER_BUFFER_SIZE) {
+            want = CARP_IO_TRANSFER_BUFFER_SIZE;
+        }
+        long n = IO_internal_read(in_fd, buffer, want);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (!IO_internal_write_all(out_fd, buffer, n)) {
+            return -1;
+        }
+        total += n;
+    }
+    return total;
+}
+
+#ifdef __linux__
+
+#ifndef SPLICE_F_MOVE
+#define SPLICE_F_MOVE 1
+#endif
+#ifndef SPLICE_F_MORE
+#define SPLICE_F_MORE 4
+#endif
+
+typedef enum {
+    IO_TRANSFER_DONE,
+    IO_TRANSFER_UNSUPPORTED,
+    IO_TRANSFER_FAILED
+} IO_internal_transfer_state;
+
+/* A kernel copy primitive moves at most `chunk` bytes and behaves like
+ * read(2): a positive count, 0 on end of input, or -1 with errno set. */
+typedef long (*IO_internal_kernel_copy)(int out_fd, int in_fd, long chunk, int *pipe_fds);
+
+long IO_internal_copy_file_range(int out_fd, int in_fd, long chunk, int *pipe_fds) {
+    (void)pipe_fds;
+#ifdef SYS_copy_file_range
+    return syscall(SYS_copy_file_range, in_fd, NULL, out_fd, NULL, (size_t)chunk, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+long IO_internal_sendfile(int out_fd, int in_fd, long chunk, int *pipe_fds) {
+    (void)pipe_fds;
+    return sendfile(out_fd, in_fd, NULL, chunk);
+}
+
+long IO_internal_splice(int out_fd, int in_fd, long chunk, int *pipe_fds) {
+#ifdef SYS_splice
+    if (pipe_fds[0] < 0 && pipe(pipe_fds) != 0) {
+        return -1;
+    }
+    long n = syscall(SYS_splice, in_fd, NULL, pipe_fds[1], NULL,
+                     (size_t)chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (n <= 0) {
+        return n;
+    }
+    /* The bytes are in the pipe now, so they must reach `out_fd` one way or
+     * another; fall back to copying them out of the pipe if splicing fails. */
+    long moved = 0;
+    while (moved < n) {
+        long m = syscall(SYS_splice, pipe_fds[0], NULL, out_fd, NULL,
+                         (size_t)(n - moved), SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (m > 0) {
+            moved += m;
+        } else if (m < 0 && errno == EINTR) {
+            continue;
+        } else {
+            long rest = IO_internal_transfer_buffered(out_fd, pipe_fds[0], n - moved);
+            if (rest != n - moved) {
+                errno = EIO;
+                return -1;
+            }
+            moved = n;
+        }
+    }
+    return n;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* copy_file_range refuses an output opened with O_APPEND with EBADF; any
+ * other EBADF means a descriptor is closed or open in the wrong mode. */
+bool IO_internal_appending(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && (flags & O_APPEND) != 0;
+}
+
+long IO_internal_transfer_kernel(IO_internal_kernel_copy copy, int out_fd, int in_fd,
+                                 long count, int *pipe_fds,
+                                 IO_internal_transfer_state *state) {
+    long total = 0;
+    *state = IO_TRANSFER_DONE;
+    while (count < 0 || total < count) {
+        long n = copy(out_fd, in_fd, IO_internal_chunk(count, total), pipe_fds);
+        if (n > 0) {
+            total += n;
+        } else if (n == 0) {
+            return total;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EINVAL || errno == EXDEV || errno == ENOSYS ||
+                   errno == ESPIPE || errno == EOPNOTSUPP ||
+                   (errno == EBADF && IO_internal_appending(out_fd))) {
+            *state = IO_TRANSFER_UNSUPPORTED;
+            return total;
+        } else {
+            *state = IO_TRANSFER_FAILED;
+            return total;
+        }
+    }
+    return total;
+}
+
+#endif
+
+long IO_transfer(int out_fd, int in_fd, long count) {
+    long total = 0;
+#ifdef __linux__
+    IO_internal_kernel_copy strategies[] = {
+        IO_internal_copy_file_range,
+        IO_internal_sendfile,
+        IO_internal_splice
+    };
+    int pipe_fds[2] = {-1, -1};
+    IO_internal_transfer_state state = IO_TRANSFER_UNSUPPORTED;
+    for (int i = 0; i < 3 && state == IO_TRANSFER_UNSUPPORTED; i++) {
+        total += IO_internal_transfer_kernel(strategies[i], out_fd, in_fd,
+                                             count < 0 ? -1 : count - total,
+                                             pipe_fds, &state);
+    }
+    if (pipe_fds[0] >= 0) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+    }
+    if (state == IO_TRANSFER_FAILED) {
+        return -1;
+    }
+    if (state == IO_TRANSFER_DONE) {
+        return total;
+    }
+#endif
+    long rest = IO_internal_transfer_buffered(out_fd, in_fd, count < 0 ? -1 : count - total);
+    if (rest < 0) {
+        return -1;
+    }
+    return total + rest;
+}
+
+bool IO_copy_MINUS_file(String *src, String *dst) {
+#ifdef _WIN32
+    int flags = _O_BINARY;
+#else
+    int flags = 0;
+#endif
+    int in_fd = open(*src, O_RDONLY | flags);
+    if (in_fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(in_fd, &st) != 0) {
+        close(in_fd);
+        return false;
+    }
+    int out_fd = open(*dst, O_WRONLY | O_CREAT | O_TRUNC | flags, st.st_mode & 0777);
+    if (out_fd < 0) {
+        close(in_fd);
+        return false;
+    }
+    long copied = IO_transfer(out_fd, in_fd, -1);
+    close(in_fd);
+    bool closed = close(out_fd) == 0;
+    /* a regular file that changed size while it was copied is not a copy */
+    bool complete = !S_ISREG(st.st_mode) || copied == (long)st.st_size;
+    return closed && copied >= 0 && complete;
+}
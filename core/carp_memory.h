@@ -6,22 +6,87 @@
 
 #include <stdio.h>
 
+/* The live byte count needs the size of a block when it is freed. Where the
+ * allocator can't tell us, only the allocation counts are tracked. */
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#define CARP_ALLOCATION_SIZE(ptr) malloc_size(ptr)
+#elif defined(_WIN32)
+#include <malloc.h>
+#define CARP_ALLOCATION_SIZE(ptr) _msize(ptr)
+#elif defined(__linux__)
+#include <malloc.h>
+#define CARP_ALLOCATION_SIZE(ptr) malloc_usable_size(ptr)
+#endif
+
 long malloc_balance_counter = 0;
 bool log_memory_balance = false;
 
+long allocation_counter = 0;
+long allocated_bytes_counter = 0;
+long live_bytes_counter = 0;
+long peak_live_bytes_counter = 0;
+
+void logged_allocation(void *ptr, size_t size) {
+    allocation_counter++;
+    allocated_bytes_counter += size;
+#ifdef CARP_ALLOCATION_SIZE
+    if(ptr) {
+        live_bytes_counter += CARP_ALLOCATION_SIZE(ptr);
+        if(live_bytes_counter > peak_live_bytes_counter) {
+            peak_live_bytes_counter = live_bytes_counter;
+        }
+    }
+#endif
+}
+
+void logged_deallocation(void *ptr) {
+#ifdef CARP_ALLOCATION_SIZE
+    if(ptr) {
+        live_bytes_counter -= CARP_ALLOCATION_SIZE(ptr);
+    }
+#endif
+}
+
 void *logged_malloc(size_t size) {
     void *ptr = malloc(size);
     if(log_memory_balance) {
         printf("MALLOC: %p (%ld bytes)\n", ptr, size);
     }
     malloc_balance_counter++;
+    logged_allocation(ptr, size);
     return ptr;
 }
 
+/* Growing a block counts as an allocation of the new size, but doesn't change
+ * the balance, since the block is still freed exactly once (unless there was
+ * no block yet). If realloc fails the old block is left as it was, and so are
+ * the counters. */
+void *logged_realloc(void *ptr, size_t size) {
+    if(log_memory_balance) {
+        printf("REALLOC: %p (%ld bytes)\n", ptr, size);
+    }
+#ifdef CARP_ALLOCATION_SIZE
+    size_t old_size = ptr ? CARP_ALLOCATION_SIZE(ptr) : 0;
+#endif
+    void *new_ptr = realloc(ptr, size);
+    if(new_ptr) {
+#ifdef CARP_ALLOCATION_SIZE
+        live_bytes_counter -= old_size;
+#endif
+        if(!ptr) {
+            malloc_balance_counter++;
+        }
+        logged_allocation(new_ptr, size);
+    }
+    return new_ptr;
+}
+
 void logged_free(void *ptr) {
     if(log_memory_balance) {
         printf("FREE: %p\n", ptr);
     }
+    logged_deallocation(ptr);
     free(ptr);
     malloc_balance_counter--;
     /* if(malloc_balance_counter == 0) { */
@@ -37,6 +102,7 @@ void Debug_log_MINUS_memory_MINUS_balance_BANG_(bool value) {
 }
 
 #define CARP_MALLOC(size) logged_malloc(size)
+#define CARP_REALLOC(ptr, size) logged_realloc(ptr, size)
 #define CARP_FREE(ptr) logged_free(ptr)
 
 long Debug_memory_MINUS_balance() {
@@ -47,9 +113,42 @@ void Debug_reset_MINUS_memory_MINUS_balance_BANG_() {
     malloc_balance_counter = 0;
 }
 
+bool Debug_memory_MINUS_logging_QMARK_() {
+    return true;
+}
+
+long Debug_allocation_MINUS_count() {
+    return allocation_counter;
+}
+
+long Debug_allocated_MINUS_bytes() {
+    return allocated_bytes_counter;
+}
+
+long Debug_live_MINUS_bytes() {
+#ifdef CARP_ALLOCATION_SIZE
+    return live_bytes_counter;
+#else
+    return -1;
+#endif
+}
+
+long Debug_peak_MINUS_live_MINUS_bytes() {
+#ifdef CARP_ALLOCATION_SIZE
+    return peak_live_bytes_counter;
+#else
+    return -1;
+#endif
+}
+
+void Debug_reset_MINUS_peak_MINUS_live_MINUS_bytes_BANG_() {
+    peak_live_bytes_counter = live_bytes_counter;
+}
+
 #else
 
 #define CARP_MALLOC(size) malloc(size)
+#define CARP_REALLOC(ptr, size) realloc(ptr, size)
 #define CARP_FREE(ptr) free(ptr)
 
 #include <stdio.h>
@@ -70,4 +169,37 @@ void Debug_log_MINUS_memory_MINUS_balance_BANG_(bool value) {
     exit(1);
 }
 
+bool Debug_memory_MINUS_logging_QMARK_() {
+    return false;
+}
+
+long Debug_allocation_MINUS_count() {
+    printf("Error - calling 'allocation-count' without compiling with LOG_MEMORY enabled (--log-memory).\n");
+    exit(1);
+    return 0;
+}
+
+long Debug_allocated_MINUS_bytes() {
+    printf("Error - calling 'allocated-bytes' without compiling with LOG_MEMORY enabled (--log-memory).\n");
+    exit(1);
+    return 0;
+}
+
+long Debug_live_MINUS_bytes() {
+    printf("Error - calling 'live-bytes' without compiling with LOG_MEMORY enabled (--log-memory).\n");
+    exit(1);
+    return 0;
+}
+
+long Debug_peak_MINUS_live_MINUS_bytes() {
+    printf("Error - calling 'peak-live-bytes' without compiling with LOG_MEMORY enabled (--log-memory).\n");
+    exit(1);
+    return 0;
+}
+
+void Debug_reset_MINUS_peak_MINUS_live_MINUS_bytes_BANG_() {
+    printf("Error - calling 'reset-peak-live-bytes!' without compiling with LOG_MEMORY enabled (--log-memory).\n");
+    exit(1);
+}
+
 #endif
@@ -0,0 +1,348 @@
+#pragma once
+
+/* A sampling profiler that is linked into programs built with --profile.
+ * SIGPROF fires at a fixed rate of CPU time (CARP_PROFILE_HZ, 997 by
+ * default), the handler walks the frame pointers of the interrupted thread
+ * and counts the stack in a fixed table, so it never allocates. At exit the
+ * stacks are written as folded stacks (one "a;b;c count" line per stack, the
+ * input format of flamegraph.pl) to CARP_PROFILE_OUTPUT, "profile.folded" by
+ * default. C symbols are turned back into Carp paths on the way out. */
+
+#if defined(CARP_PROFILE) && !defined(_WIN32)
+
+#include "carp_stdbool.h"
+#include <dlfcn.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+/* macOS only declares ucontext_t for XSI programs */
+#if defined(__APPLE__) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 700
+#endif
+#include <ucontext.h>
+
+#define CARP_PROFILE_MAX_DEPTH 64
+#define CARP_PROFILE_STACKS 4096
+
+/* SIGPROF goes to whichever thread is running, so samples from several
+ * threads can update the table at the same time. A slot is claimed by
+ * moving its state from empty to filling with a compare-and-swap, and
+ * only compared against once it is ready; counts are added atomically. A
+ * stack that finds its slot still filling probes on and may end up in a
+ * second slot, which is merged with the first when the profile is written. */
+enum { CARP_PROFILE_EMPTY, CARP_PROFILE_FILLING, CARP_PROFILE_READY };
+
+typedef struct {
+    int state;
+    uint64_t hash;
+    long count;
+    int depth;
+    void *pcs[CARP_PROFILE_MAX_DEPTH];
+} Profile_internal_stack;
+
+Profile_internal_stack Profile_internal_stacks[CARP_PROFILE_STACKS];
+long Profile_internal_dropped = 0;
+size_t Profile_internal_stack_size = 8 << 20;
+
+/* The program counter and frame pointer of the interrupted code. Without a
+ * known register layout, the walk starts at the handler's own frame and the
+ * interrupted function itself is missing from the stack. */
+void Profile_internal_registers(void *context, void **pc, void ***fp) {
+    ucontext_t *uc = (ucontext_t *)context;
+#if defined(__linux__) && defined(__x86_64__)
+    *pc = (void *)uc->uc_mcontext.gregs[16]; /* REG_RIP */
+    *fp = (void **)uc->uc_mcontext.gregs[10]; /* REG_RBP */
+#elif defined(__linux__) && defined(__aarch64__)
+    *pc = (void *)uc->uc_mcontext.pc;
+    *fp = (void **)uc->uc_mcontext.regs[29];
+#elif defined(__APPLE__) && defined(__x86_64__)
+    *pc = (void *)uc->uc_mcontext->__ss.__rip;
+    *fp = (void **)uc->uc_mcontext->__ss.__rbp;
+#else
+    (void)uc;
+    *pc = NULL;
+    *fp = (void **)__builtin_frame_address(0);
+#endif
+}
+
+void Profile_internal_sample(int signal, siginfo_t *info, void *context) {
+    (void)signal;
+    (void)info;
+    void *pcs[CARP_PROFILE_MAX_DEPTH];
+    int depth = 0;
+    void *pc;
+    void **fp;
+    Profile_internal_registers(context, &pc, &fp);
+    if (pc) {
+        pcs[depth++] = pc;
+    }
+    /* The handler runs on the stack of the interrupted thread, whichever it
+     * is, so its frames lie above the handler's own frame and within a stack
+     * size of it. The chain ends with a null frame pointer at the thread's
+     * entry point. Code built without frame pointers uses the register for
+     * other things, so anything outside of that range (or not moving up)
+     * ends the walk too. */
+    char *low = (char *)__builtin_frame_address(0);
+    while (depth < CARP_PROFILE_MAX_DEPTH && fp != NULL && (char *)fp >= low &&
+           (size_t)((char *)fp - low) < Profile_internal_stack_size &&
+           ((uintptr_t)fp & (sizeof(void *) - 1)) == 0) {
+        void **next = (void **)fp[0];
+        if (!fp[1]) {
+            break;
+        }
+        pcs[depth++] = fp[1];
+        if (next <= fp) {
+            break;
+        }
+        fp = next;
+    }
+    if (depth == 0) {
+        return;
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < depth; i++) {
+        hash = (hash ^ (uint64_t)(uintptr_t)pcs[i]) * 1099511628211ULL;
+    }
+    for (int probe = 0; probe < CARP_PROFILE_STACKS; probe++) {
+        Profile_internal_stack *s = &Profile_internal_stacks[(hash + probe) % CARP_PROFILE_STACKS];
+        int state = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+        if (state == CARP_PROFILE_EMPTY &&
+            __atomic_compare_exchange_n(&s->state, &state, CARP_PROFILE_FILLING, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            s->hash = hash;
+            s->depth = depth;
+            memcpy(s->pcs, pcs, depth * sizeof(void *));
+            s->count = 1;
+            __atomic_store_n(&s->state, CARP_PROFILE_READY, __ATOMIC_RELEASE);
+            return;
+        }
+        if (state == CARP_PROFILE_READY && s->hash == hash && s->depth == depth &&
+            memcmp(s->pcs, pcs, depth * sizeof(void *)) == 0) {
+            __atomic_add_fetch(&s->count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    __atomic_add_fetch(&Profile_internal_dropped, 1, __ATOMIC_RELAXED);
+}
+
+const char *Profile_internal_mangled[][2] = {
+    {"_PLUS_", "+"}, {"_MINUS_", "-"}, {"_MUL_", "*"}, {"_DIV_", "/"},
+    {"_LT_", "<"}, {"_GT_", ">"}, {"_QMARK_", "?"}, {"_BANG_", "!"},
+    {"_EQ_", "="}};
+
+const char *Profile_internal_c_types[][2] = {
+    {"int", "Int"}, {"long", "Long"}, {"double", "Double"},
+    {"float", "Float"}, {"bool", "Bool"}, {"char", "Char"},
+    {"void", "()"}};
+
+#define CARP_PROFILE_COUNT(table) (int)(sizeof(table) / sizeof(table[0]))
+
+/* The index of the mangled character that starts at `c`, or -1. */
+int Profile_internal_mangled_at(const char *c) {
+    for (int i = 0; i < CARP_PROFILE_COUNT(Profile_internal_mangled); i++) {
+        if (strncmp(c, Profile_internal_mangled[i][0], strlen(Profile_internal_mangled[i][0])) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Reverses the naming scheme of the compiler (pathToC, mangle and the
+ * polymorphic suffix), so "Map_put__int_int" becomes "Map.put<Int,Int>",
+ * "Int__PLUS_" becomes "Int.+" and "Foo__Lambda_main_12" becomes
+ * "Foo.main(fn-12)". Nested type arguments are flattened into the list. */
+void Profile_internal_carp_name(const char *c, char *out, size_t size) {
+    size_t n = 0;
+    bool in_types = false;
+    bool type_start = false;
+    const char *lambda = strstr(c, "_Lambda_");
+#define CARP_PROFILE_PUTS(s) \
+    do { for (const char *p = (s); *p; p++) if (n + 1 < size) out[n++] = *p; } while (0)
+    while (*c) {
+        if (c == lambda) {
+            /* _Lambda_<function>_<id> */
+            const char *id = strrchr(c, '_');
+            char function[256];
+            size_t length = id - (c + 8);
+            if (length >= sizeof(function)) {
+                length = sizeof(function) - 1;
+            }
+            memcpy(function, c + 8, length);
+            function[length] = '\0';
+            char demangled[256];
+            Profile_internal_carp_name(function, demangled, sizeof(demangled));
+            CARP_PROFILE_PUTS(demangled);
+            CARP_PROFILE_PUTS("(fn-");
+            CARP_PROFILE_PUTS(id + 1);
+            CARP_PROFILE_PUTS(")");
+            break;
+        }
+        int mangled = Profile_internal_mangled_at(c);
+        if (mangled >= 0) {
+            CARP_PROFILE_PUTS(Profile_internal_mangled[mangled][1]);
+            c += strlen(Profile_internal_mangled[mangled][0]);
+            type_start = false;
+            continue;
+        }
+        if (c[0] == '_' && n > 0) {
+            bool suffix = !in_types && c[1] == '_' && c[2] != '\0' &&
+                          c + 1 != lambda && Profile_internal_mangled_at(c + 1) < 0;
+            CARP_PROFILE_PUTS(in_types ? "," : suffix ? "<" : ".");
+            in_types = in_types || suffix;
+            type_start = in_types;
+            c += (suffix || (in_types && c[1] == '_')) ? 2 : 1;
+            continue;
+        }
+        if (type_start) {
+            type_start = false;
+            int i = 0;
+            for (; i < CARP_PROFILE_COUNT(Profile_internal_c_types); i++) {
+                size_t length = strlen(Profile_internal_c_types[i][0]);
+                if (strncmp(c, Profile_internal_c_types[i][0], length) == 0 &&
+                    (c[length] == '_' || c[length] == '\0')) {
+                    CARP_PROFILE_PUTS(Profile_internal_c_types[i][1]);
+                    c += length;
+                    break;
+                }
+            }
+            if (i < CARP_PROFILE_COUNT(Profile_internal_c_types)) {
+                continue;
+            }
+        }
+        char ch[2] = {*c, '\0'};
+        CARP_PROFILE_PUTS(ch);
+        c++;
+    }
+    if (in_types) {
+        CARP_PROFILE_PUTS(">");
+    }
+#undef CARP_PROFILE_PUTS
+    out[n] = '\0';
+}
+
+/* Symbols from the program itself are Carp definitions, anything from a
+ * shared library (libc, SDL, ...) keeps its C name. Return addresses point
+ * after the call, so they are looked up one byte earlier. */
+void Profile_internal_frame_name(void *pc, bool leaf, const char *program, char *out, size_t size) {
+    Dl_info info;
+    if (!dladdr((char *)pc - (leaf ? 0 : 1), &info)) {
+        snprintf(out, size, "%p", pc);
+    } else if (!info.dli_sname) {
+        const char *file = info.dli_fname ? strrchr(info.dli_fname, '/') : NULL;
+        snprintf(out, size, "[%s]", file ? file + 1 : info.dli_fname ? info.dli_fname : "unknown");
+    } else if (program && info.dli_fname && strcmp(info.dli_fname, program) == 0) {
+        Profile_internal_carp_name(info.dli_sname, out, size);
+    } else {
+        snprintf(out, size, "%s", info.dli_sname);
+    }
+}
+
+typedef struct {
+    char *stack;
+    long count;
+} Profile_internal_line;
+
+int Profile_internal_compare_lines(const void *a, const void *b) {
+    return strcmp(((const Profile_internal_line *)a)->stack, ((const Profile_internal_line *)b)->stack);
+}
+
+/* Stacks that only differ in the instruction within a function have the same
+ * names, so the lines are sorted and merged before they are written. */
+void Profile_internal_write() {
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+    signal(SIGPROF, SIG_IGN);
+
+    const char *path = getenv("CARP_PROFILE_OUTPUT");
+    if (!path) {
+        path = "profile.folded";
+    }
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Can't write the profile to '%s'.\n", path);
+        return;
+    }
+    Dl_info self;
+    const char *program = dladdr((void *)Profile_internal_write, &self) ? self.dli_fname : NULL;
+    Profile_internal_line *lines = malloc(CARP_PROFILE_STACKS * sizeof(Profile_internal_line));
+    int line_count = 0;
+    long samples = 0;
+    char name[512];
+    for (int i = 0; i < CARP_PROFILE_STACKS; i++) {
+        Profile_internal_stack *s = &Profile_internal_stacks[i];
+        if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) != CARP_PROFILE_READY) {
+            continue;
+        }
+        size_t length = 0;
+        size_t capacity = 256;
+        char *stack = malloc(capacity);
+        for (int frame = s->depth - 1; frame >= 0; frame--) {
+            Profile_internal_frame_name(s->pcs[frame], frame == 0, program, name, sizeof(name));
+            size_t name_length = strlen(name);
+            while (length + name_length + 2 > capacity) {
+                capacity *= 2;
+                stack = realloc(stack, capacity);
+            }
+            memcpy(stack + length, name, name_length);
+            length += name_length;
+            stack[length++] = frame == 0 ? '\0' : ';';
+        }
+        lines[line_count].stack = stack;
+        lines[line_count].count = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+        samples += lines[line_count].count;
+        line_count++;
+    }
+    qsort(lines, line_count, sizeof(Profile_internal_line), Profile_internal_compare_lines);
+    for (int i = 0; i < line_count; i++) {
+        long count = lines[i].count;
+        while (i + 1 < line_count && strcmp(lines[i].stack, lines[i + 1].stack) == 0) {
+            free(lines[i].stack);
+            count += lines[++i].count;
+        }
+        fprintf(f, "%s %ld\n", lines[i].stack, count);
+        free(lines[i].stack);
+    }
+    free(lines);
+    fclose(f);
+    fprintf(stderr, "Wrote %ld samples to '%s'", samples, path);
+    long dropped = __atomic_load_n(&Profile_internal_dropped, __ATOMIC_RELAXED);
+    if (dropped > 0) {
+        fprintf(stderr, " (%ld dropped, too many different stacks)", dropped);
+    }
+    fprintf(stderr, ".\n");
+}
+
+__attribute__((constructor)) void Profile_internal_start() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+        limit.rlim_cur > Profile_internal_stack_size) {
+        Profile_internal_stack_size = limit.rlim_cur;
+    }
+    /* setitimer counts in microseconds, so faster rates are clamped. */
+    long hz = 997;
+    const char *rate = getenv("CARP_PROFILE_HZ");
+    if (rate && atol(rate) > 0) {
+        hz = atol(rate) < 1000000 ? atol(rate) : 1000000;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = Profile_internal_sample;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = hz == 1 ? 1 : 0;
+    timer.it_interval.tv_usec = hz == 1 ? 0 : 1000000 / hz;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+    atexit(Profile_internal_write);
+}
+
+#endif
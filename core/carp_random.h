@@ -0,0 +1,543 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <carp_memory.h>
+#include <core.h>
+#include <carp_system.h>
+
+/* The generator behind the Random module: xoshiro256** (Blackman and
+ * Vigna), 256 bits of state and a period of 2^256 - 1. A seed is expanded
+ * into the state with splitmix64, which never yields the all-zero state.
+ *
+ * Bounded integers use Lemire's multiply-and-reject method, which is
+ * unbiased and needs a division only in the rare rejection case. Doubles
+ * take the top 53 bits, so they are uniform in [0, 1).
+ *
+ * Every thread has its own default generator, seeded on first use; the
+ * first thread always starts from the same seed so that programs are
+ * reproducible unless they call Random.seed. */
+
+typedef struct {
+    uint64_t s[4];
+} Rng;
+
+#define CARP_RANDOM_SEED 0x2545f4914f6cdd1dULL
+
+static inline uint64_t Random_internal_splitmix(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t Random_internal_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t Random_internal_next(Rng *r) {
+    uint64_t *s = r->s;
+    uint64_t result = Random_internal_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = Random_internal_rotl(s[3], 45);
+    return result;
+}
+
+/* A uniform integer in [0, n). */
+static inline uint32_t Random_internal_below32(Rng *r, uint32_t n) {
+    uint64_t m = (Random_internal_next(r) >> 32) * (uint64_t)n;
+    uint32_t low = (uint32_t)m;
+    if (low < n) {
+        uint32_t threshold = -n % n;
+        while (low < threshold) {
+            m = (Random_internal_next(r) >> 32) * (uint64_t)n;
+            low = (uint32_t)m;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
+
+static inline uint64_t Random_internal_below64(Rng *r, uint64_t n) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t m = (__uint128_t)Random_internal_next(r) * n;
+    uint64_t low = (uint64_t)m;
+    if (low < n) {
+        uint64_t threshold = -n % n;
+        while (low < threshold) {
+            m = (__uint128_t)Random_internal_next(r) * n;
+            low = (uint64_t)m;
+        }
+    }
+    return (uint64_t)(m >> 64);
+#else
+    uint64_t threshold = -n % n;
+    uint64_t x = Random_internal_next(r);
+    while (x < threshold) {
+        x = Random_internal_next(r);
+    }
+    return x % n;
+#endif
+}
+
+/* Bulk generation. A stream runs CARP_RANDOM_LANES xoshiro256** generators
+ * side by side, with the state stored lane-major so that the compiler turns
+ * each step into vector instructions, and buffers a few rounds of output.
+ * The lanes are seeded from the next outputs of the generator passed to
+ * the fill function, so a fill is as reproducible as the generator. */
+
+#ifndef CARP_RANDOM_LANES
+#define CARP_RANDOM_LANES 4
+#endif
+
+#define CARP_RANDOM_ROUNDS 16
+
+typedef struct {
+    uint64_t s[4][CARP_RANDOM_LANES];
+    uint64_t buffer[CARP_RANDOM_ROUNDS * CARP_RANDOM_LANES];
+    int next;
+} Random_internal_stream;
+
+static void Random_internal_stream_init(Random_internal_stream *st, Rng *r) {
+    for (int i = 0; i < CARP_RANDOM_LANES; i++) {
+        uint64_t x = Random_internal_next(r);
+        for (int j = 0; j < 4; j++) {
+            st->s[j][i] = Random_internal_splitmix(&x);
+        }
+    }
+    st->next = CARP_RANDOM_ROUNDS * CARP_RANDOM_LANES;
+}
+
+static void Random_internal_stream_refill(Random_internal_stream *st) {
+    uint64_t *s0 = st->s[0], *s1 = st->s[1], *s2 = st->s[2], *s3 = st->s[3];
+    for (int round = 0; round < CARP_RANDOM_ROUNDS; round++) {
+        uint64_t *out = st->buffer + round * CARP_RANDOM_LANES;
+        for (int i = 0; i < CARP_RANDOM_LANES; i++) {
+            out[i] = Random_internal_rotl(s1[i] * 5, 7) * 9;
+            uint64_t t = s1[i] << 17;
+            s2[i] ^= s0[i];
+            s3[i] ^= s1[i];
+            s1[i] ^= s2[i];
+            s0[i] ^= s3[i];
+            s2[i] ^= t;
+            s3[i] = Random_internal_rotl(s3[i], 45);
+        }
+    }
+    st->next = 0;
+}
+
+static inline uint64_t Random_internal_stream_next(Random_internal_stream *st) {
+    if (st->next == CARP_RANDOM_ROUNDS * CARP_RANDOM_LANES) {
+        Random_internal_stream_refill(st);
+    }
+    return st->buffer[st->next++];
+}
+
+/* The normal distribution with the ziggurat method of Marsaglia and Tsang
+ * (2000), 128 layers. The layer index comes from the low bits of a draw and
+ * the position within the layer from the high 32 bits, so that the two
+ * aren't correlated. About 99% of the samples need one draw and a
+ * multiplication. The tables are per thread, built on first use. */
+
+#define CARP_RANDOM_ZIGGURAT_R 3.442619855899
+
+typedef struct {
+    uint32_t k[128];
+    double w[128];
+    double f[128];
+    bool ready;
+} Random_internal_ziggurat;
+
+_Thread_local Random_internal_ziggurat Random_internal_normal_tables;
+
+static Random_internal_ziggurat *Random_internal_normal_ziggurat() {
+    Random_internal_ziggurat *z = &Random_internal_normal_tables;
+    if (z->ready) {
+        return z;
+    }
+    const double m = 2147483648.0;
+    const double v = 9.91256303526217e-3;
+    double d = CARP_RANDOM_ZIGGURAT_R;
+    double t = d;
+    double q = v / exp(-0.5 * d * d);
+    z->k[0] = (uint32_t)((d / q) * m);
+    z->k[1] = 0;
+    z->w[0] = q / m;
+    z->w[127] = d / m;
+    z->f[0] = 1.0;
+    z->f[127] = exp(-0.5 * d * d);
+    for (int i = 126; i >= 1; i--) {
+        d = sqrt(-2.0 * log(v / d + exp(-0.5 * d * d)));
+        z->k[i + 1] = (uint32_t)((d / t) * m);
+        t = d;
+        z->f[i] = exp(-0.5 * d * d);
+        z->w[i] = d / m;
+    }
+    z->ready = true;
+    return z;
+}
+
+/* The Poisson distribution: Knuth's product of uniforms for small means,
+ * and Hoermann's transformed rejection (PTRS, 1993) otherwise, which takes
+ * about one draw per sample regardless of the mean. */
+/* The samplers are written once for both sources of bits: a stream for the
+ * fill functions, and a plain generator for single samples. */
+#define CARP_RANDOM_SAMPLERS(P, S, NEXT)                                          \
+    static inline double P##_double(S *src) {                                     \
+        return (double)(NEXT(src) >> 11) * 0x1.0p-53;                             \
+    }                                                                             \
+                                                                                  \
+    static double P##_normal(S *src, Random_internal_ziggurat *z) {               \
+        for (;;) {                                                                \
+            uint64_t bits = NEXT(src);                                            \
+            int i = bits & 127;                                                   \
+            int32_t h = (int32_t)(bits >> 32);                                    \
+            double x = h * z->w[i];                                               \
+            if ((uint32_t)(h < 0 ? -(int64_t)h : h) < z->k[i]) {                  \
+                return x;                                                         \
+            }                                                                     \
+            if (i == 0) {                                                         \
+                /* The tail beyond R, by Marsaglia's method. */                   \
+                double y;                                                         \
+                do {                                                              \
+                    x = -log1p(-P##_double(src)) / CARP_RANDOM_ZIGGURAT_R;        \
+                    y = -log1p(-P##_double(src));                                 \
+                } while (y + y < x * x);                                          \
+                return h > 0 ? CARP_RANDOM_ZIGGURAT_R + x                         \
+                             : -CARP_RANDOM_ZIGGURAT_R - x;                       \
+            }                                                                     \
+            if (z->f[i] + P##_double(src) * (z->f[i - 1] - z->f[i]) <             \
+                exp(-0.5 * x * x)) {                                              \
+                return x;                                                         \
+            }                                                                     \
+        }                                                                         \
+    }                                                                             \
+                                                                                  \
+    static int P##_poisson(S *src, double lambda) {                               \
+        if (lambda <= 0.0) {                                                      \
+            return 0;                                                             \
+        }                                                                         \
+        if (lambda < 10.0) {                                                      \
+            double limit = exp(-lambda);                                          \
+            double p = P##_double(src);                                           \
+            int k = 0;                                                            \
+            while (p > limit) {                                                   \
+                p *= P##_double(src);                                             \
+                k++;                                                              \
+            }                                                                     \
+            return k;                                                             \
+        }                                                                         \
+        double slam = sqrt(lambda);                                               \
+        double loglam = log(lambda);                                              \
+        double b = 0.931 + 2.53 * slam;                                           \
+        double a = -0.059 + 0.02483 * b;                                          \
+        double invalpha = 1.1239 + 1.1328 / (b - 3.4);                            \
+        double vr = 0.9277 - 3.6224 / (b - 2.0);                                  \
+        for (;;) {                                                                \
+            double u = P##_double(src) - 0.5;                                     \
+            double v = P##_double(src);                                           \
+            double us = 0.5 - fabs(u);                                            \
+            double k = floor((2.0 * a / us + b) * u + lambda + 0.43);             \
+            if (us >= 0.07 && v <= vr) {                                          \
+                return (int)k;                                                    \
+            }                                                                     \
+            if (k < 0.0 || (us < 0.013 && v > us)) {                              \
+                continue;                                                         \
+            }                                                                     \
+            if (log(v) + log(invalpha) - log(a / (us * us) + b) <=                \
+                -lambda + k * loglam - lgamma(k + 1.0)) {                         \
+                return (int)k;                                                    \
+            }                                                                     \
+        }                                                                         \
+    }
+
+CARP_RANDOM_SAMPLERS(Random_internal_stream, Random_internal_stream, Random_internal_stream_next)
+CARP_RANDOM_SAMPLERS(Random_internal, Rng, Random_internal_next)
+
+Rng Rng_from_MINUS_seed(long seed) {
+    Rng r;
+    uint64_t x = (uint64_t)seed;
+    for (int i = 0; i < 4; i++) {
+        r.s[i] = Random_internal_splitmix(&x);
+    }
+    return r;
+}
+
+/* Distinct for every call, even within the same nanosecond. */
+Rng Rng_create() {
+    static long calls = 0;
+    long n = __atomic_add_fetch(&calls, 1, __ATOMIC_RELAXED);
+    uint64_t x = (uint64_t)System_nanotime() ^ ((uint64_t)n * 0xd1b54a32d192ed03ULL);
+    return Rng_from_MINUS_seed((long)Random_internal_splitmix(&x));
+}
+
+long Rng_next_MINUS_u64(Rng *r) {
+    return (long)Random_internal_next(r);
+}
+
+int Rng_int_MINUS_between(Rng *r, int lower, int upper) {
+    if (upper <= lower) {
+        return lower;
+    }
+    uint32_t n = (uint32_t)upper - (uint32_t)lower;
+    return (int)((uint32_t)lower + Random_internal_below32(r, n));
+}
+
+long Rng_long_MINUS_between(Rng *r, long lower, long upper) {
+    if (upper <= lower) {
+        return lower;
+    }
+    uint64_t n = (uint64_t)upper - (uint64_t)lower;
+    return (long)((uint64_t)lower + Random_internal_below64(r, n));
+}
+
+double Rng_double(Rng *r) {
+    return Random_internal_double(r);
+}
+
+float Rng_float(Rng *r) {
+    return (float)(Random_internal_next(r) >> 40) * 0x1.0p-24f;
+}
+
+/* Advances the state by 2^128 steps, for handing out non-overlapping
+ * streams to parallel workers. */
+void Rng_jump_BANG_(Rng *r) {
+    static const uint64_t jump[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+    uint64_t s[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (jump[i] & (1ULL << b)) {
+                for (int j = 0; j < 4; j++) {
+                    s[j] ^= r->s[j];
+                }
+            }
+            Random_internal_next(r);
+        }
+    }
+    memcpy(r->s, s, sizeof(s));
+}
+
+void Rng_fill_MINUS_doubles_BANG_(Rng *r, Array *a) {
+    Random_internal_stream st;
+    Random_internal_stream_init(&st, r);
+    double *p = a->data;
+    for (size_t i = 0; i < a->len; i++) {
+        p[i] = Random_internal_stream_double(&st);
+    }
+}
+
+void Rng_fill_MINUS_ints_BANG_(Rng *r, Array *a, int lower, int upper) {
+    int *p = a->data;
+    if (upper <= lower) {
+        for (size_t i = 0; i < a->len; i++) {
+            p[i] = lower;
+        }
+        return;
+    }
+    Random_internal_stream st;
+    Random_internal_stream_init(&st, r);
+    uint32_t n = (uint32_t)upper - (uint32_t)lower;
+    uint32_t threshold = -n % n;
+    for (size_t i = 0; i < a->len; i++) {
+        uint64_t m;
+        do {
+            m = (Random_internal_stream_next(&st) >> 32) * (uint64_t)n;
+        } while ((uint32_t)m < threshold);
+        p[i] = (int)((uint32_t)lower + (uint32_t)(m >> 32));
+    }
+}
+
+void Rng_fill_MINUS_normal_BANG_(Rng *r, Array *a, double mean, double stdev) {
+    Random_internal_stream st;
+    Random_internal_stream_init(&st, r);
+    Random_internal_ziggurat *z = Random_internal_normal_ziggurat();
+    double *p = a->data;
+    for (size_t i = 0; i < a->len; i++) {
+        p[i] = mean + stdev * Random_internal_stream_normal(&st, z);
+    }
+}
+
+/* By inversion; the logarithm vectorizes where the ziggurat's branches
+ * wouldn't. */
+void Rng_fill_MINUS_exponential_BANG_(Rng *r, Array *a, double rate) {
+    Random_internal_stream st;
+    Random_internal_stream_init(&st, r);
+    double *p = a->data;
+    for (size_t i = 0; i < a->len; i++) {
+        p[i] = Random_internal_stream_double(&st);
+    }
+    for (size_t i = 0; i < a->len; i++) {
+        p[i] = -log1p(-p[i]) / rate;
+    }
+}
+
+void Rng_fill_MINUS_poisson_BANG_(Rng *r, Array *a, double lambda) {
+    Random_internal_stream st;
+    Random_internal_stream_init(&st, r);
+    int *p = a->data;
+    for (size_t i = 0; i < a->len; i++) {
+        p[i] = Random_internal_stream_poisson(&st, lambda);
+    }
+}
+
+double Rng_normal(Rng *r, double mean, double stdev) {
+    return mean + stdev * Random_internal_normal(r, Random_internal_normal_ziggurat());
+}
+
+double Rng_exponential(Rng *r, double rate) {
+    return -log1p(-Random_internal_double(r)) / rate;
+}
+
+int Rng_poisson(Rng *r, double lambda) {
+    return Random_internal_poisson(r, lambda);
+}
+
+/* Vose's alias method: `prob` and `alias` get one entry per weight, and a
+ * sample picks an entry uniformly, then keeps it with probability prob[i]
+ * or takes alias[i] instead. Weights that don't sum to anything positive
+ * give the uniform distribution; a table without weights only gives -1. */
+void AliasTable_internal_build(Array *weights, Array *prob, Array *alias) {
+    size_t n = weights->len;
+    if (n == 0) {
+        return;
+    }
+    const double *w = weights->data;
+    double *pr = prob->data;
+    int *al = alias->data;
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += w[i] > 0.0 ? w[i] : 0.0;
+    }
+    int *small = CARP_MALLOC(n * sizeof(int));
+    int *large = CARP_MALLOC(n * sizeof(int));
+    size_t ns = 0, nl = 0;
+    for (size_t i = 0; i < n; i++) {
+        pr[i] = sum > 0.0 ? (w[i] > 0.0 ? w[i] : 0.0) * n / sum : 1.0;
+        al[i] = (int)i;
+        if (pr[i] < 1.0) {
+            small[ns++] = (int)i;
+        } else {
+            large[nl++] = (int)i;
+        }
+    }
+    while (ns > 0 && nl > 0) {
+        int s = small[--ns];
+        int l = large[nl - 1];
+        al[s] = l;
+        pr[l] -= 1.0 - pr[s];
+        if (pr[l] < 1.0) {
+            nl--;
+            small[ns++] = l;
+        }
+    }
+    /* Whatever is left is 1 up to rounding. */
+    while (nl > 0) {
+        pr[large[--nl]] = 1.0;
+    }
+    while (ns > 0) {
+        pr[small[--ns]] = 1.0;
+    }
+    CARP_FREE(small);
+    CARP_FREE(large);
+}
+
+static inline int AliasTable_internal_pick(uint64_t bits, const double *prob, const int *alias,
+                                           uint32_t n) {
+    uint32_t i = (uint32_t)(((bits >> 32) * (uint64_t)n) >> 32);
+    double u = (double)(bits & 0xffffffffULL) * 0x1.0p-32;
+    return u < prob[i] ? (int)i : alias[i];
+}
+
+void AliasTable_internal_fill(Rng *r, Array *prob, Array *alias, Array *out) {
+    int *p = out->data;
+    if (prob->len == 0) {
+        for (size_t i = 0; i < out->len; i++) {
+            p[i] = -1;
+        }
+        return;
+    }
+    Random_internal_stream st;
+    Random_internal_stream_init(&st, r);
+    for (size_t i = 0; i < out->len; i++) {
+        p[i] = AliasTable_internal_pick(Random_internal_stream_next(&st), prob->data, alias->data,
+                                        (uint32_t)prob->len);
+    }
+}
+
+int AliasTable_internal_sample(Rng *r, Array *prob, Array *alias) {
+    if (prob->len == 0) {
+        return -1;
+    }
+    return AliasTable_internal_pick(Random_internal_next(r), prob->data, alias->data,
+                                    (uint32_t)prob->len);
+}
+
+bool Rng__EQ_(Rng a, Rng b) {
+    return memcmp(a.s, b.s, sizeof(a.s)) == 0;
+}
+
+Rng Rng_copy(Rng *r) {
+    return *r;
+}
+
+String Rng_str(Rng r) {
+    (void)r;
+    String buffer = CARP_MALLOC(6);
+    strcpy(buffer, "(Rng)");
+    return buffer;
+}
+
+_Thread_local Rng Random_internal_default;
+_Thread_local bool Random_internal_seeded = false;
+
+Rng *Random_default() {
+    if (!Random_internal_seeded) {
+        static long threads = 0;
+        long n = __atomic_fetch_add(&threads, 1, __ATOMIC_RELAXED);
+        Random_internal_default = Rng_from_MINUS_seed(CARP_RANDOM_SEED);
+        for (long i = 0; i < n; i++) {
+            Rng_jump_BANG_(&Random_internal_default);
+        }
+        Random_internal_seeded = true;
+    }
+    return &Random_internal_default;
+}
+
+void Random_seed() {
+    *Random_default() = Rng_create();
+}
+
+void Random_seed_MINUS_from(double seed) {
+    long bits;
+    memcpy(&bits, &seed, sizeof(bits));
+    *Random_default() = Rng_from_MINUS_seed(bits);
+}
+
+double Random_random() {
+    return Random_internal_double(Random_default());
+}
+
+int Random_int_MINUS_between(int lower, int upper) {
+    return Rng_int_MINUS_between(Random_default(), lower, upper);
+}
+
+long Random_long_MINUS_between(long lower, long upper) {
+    return Rng_long_MINUS_between(Random_default(), lower, upper);
+}
+
+/* Printable ASCII, from ' ' to '~'. */
+String String_random_MINUS_sized(int n) {
+    Rng *r = Random_default();
+    String s = CARP_MALLOC(n + 1);
+    for (int i = 0; i < n; i++) {
+        s[i] = (char)(' ' + Random_internal_below32(r, '~' - ' ' + 1));
+    }
+    s[n] = '\0';
+    return s;
+}
@@ -0,0 +1,279 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+
+#include <core.h>
+
+/* Fixed-width vectors for the Simd module: F32x4 (4 floats), F64x4 (4
+ * doubles) and I32x8 (8 ints), each a struct with the lanes in `v`. With
+ * GCC and Clang `v` is a vector extension type, so the arithmetic compiles
+ * to whatever the target has (SSE, AVX, NEON), and to pairs of registers
+ * when a vector is wider than the hardware. Anywhere else, or with
+ * -D CARP_SIMD_SCALAR, `v` is a plain array and every operation is a loop
+ * over the lanes.
+ *
+ * Comparisons return a bit mask in an Int, bit i set when lane i compares
+ * true; `blend` takes such a mask. */
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(CARP_SIMD_SCALAR)
+#define CARP_SIMD_NATIVE
+#endif
+
+#ifdef CARP_SIMD_NATIVE
+
+/* The vectors are wrapped in structs: a bare 32-byte vector is passed in an
+ * AVX register when AVX is enabled and in memory otherwise, so its calling
+ * convention would depend on -mavx. For the same reason the 32-byte ones
+ * are only aligned to 16 bytes, the alignment every x86-64 target agrees on
+ * for arguments passed in memory. */
+typedef float Simd_internal_vec_F32x4 __attribute__((vector_size(16)));
+typedef double Simd_internal_vec_F64x4 __attribute__((vector_size(32), aligned(16)));
+typedef int Simd_internal_vec_I32x8 __attribute__((vector_size(32), aligned(16)));
+
+typedef struct {
+    Simd_internal_vec_F32x4 v;
+} F32x4;
+typedef struct {
+    Simd_internal_vec_F64x4 v;
+} F64x4;
+typedef struct {
+    Simd_internal_vec_I32x8 v;
+} I32x8;
+
+typedef int Simd_internal_mask_F32x4 __attribute__((vector_size(16)));
+typedef long long Simd_internal_mask_F64x4 __attribute__((vector_size(32)));
+typedef int Simd_internal_mask_I32x8 __attribute__((vector_size(32)));
+
+#define CARP_SIMD_BINARY(T, M, N, name, op) \
+    static inline T T##_##name(T a, T b) {  \
+        T r;                                \
+        r.v = a.v op b.v;                   \
+        return r;                           \
+    }
+
+#define CARP_SIMD_SELECT(T, M, N, name, op)                              \
+    static inline T T##_##name(T a, T b) {                               \
+        M m = (M)(a.v op b.v);                                           \
+        T r;                                                             \
+        r.v = (Simd_internal_vec_##T)(((M)a.v & m) | ((M)b.v & ~m));     \
+        return r;                                                        \
+    }
+
+#define CARP_SIMD_COMPARE(T, M, N, name, op)            \
+    static inline int T##_##name(T a, T b) {            \
+        M m = (M)(a.v op b.v);                          \
+        int bits = 0;                                   \
+        for (int i = 0; i < N; i++) {                   \
+            bits |= (m[i] != 0) << i;                   \
+        }                                               \
+        return bits;                                    \
+    }
+
+#define CARP_SIMD_BLEND(T, M, N)                                         \
+    static inline T T##_blend(int bits, T a, T b) {                      \
+        M m;                                                             \
+        for (int i = 0; i < N; i++) {                                    \
+            m[i] = (bits >> i) & 1 ? -1 : 0;                             \
+        }                                                                \
+        T r;                                                             \
+        r.v = (Simd_internal_vec_##T)(((M)a.v & m) | ((M)b.v & ~m));     \
+        return r;                                                        \
+    }
+
+#else
+
+typedef struct {
+    float v[4];
+} F32x4;
+typedef struct {
+    double v[4];
+} F64x4;
+typedef struct {
+    int v[8];
+} I32x8;
+
+#define CARP_SIMD_BINARY(T, M, N, name, op) \
+    static inline T T##_##name(T a, T b) {  \
+        T r;                                \
+        for (int i = 0; i < N; i++) {       \
+            r.v[i] = a.v[i] op b.v[i];      \
+        }                                   \
+        return r;                           \
+    }
+
+#define CARP_SIMD_SELECT(T, M, N, name, op)                      \
+    static inline T T##_##name(T a, T b) {                       \
+        T r;                                                     \
+        for (int i = 0; i < N; i++) {                            \
+            r.v[i] = a.v[i] op b.v[i] ? a.v[i] : b.v[i];         \
+        }                                                        \
+        return r;                                                \
+    }
+
+#define CARP_SIMD_COMPARE(T, M, N, name, op)            \
+    static inline int T##_##name(T a, T b) {            \
+        int bits = 0;                                   \
+        for (int i = 0; i < N; i++) {                   \
+            bits |= (a.v[i] op b.v[i]) << i;            \
+        }                                               \
+        return bits;                                    \
+    }
+
+#define CARP_SIMD_BLEND(T, M, N)                             \
+    static inline T T##_blend(int bits, T a, T b) {          \
+        T r;                                                 \
+        for (int i = 0; i < N; i++) {                        \
+            r.v[i] = (bits >> i) & 1 ? a.v[i] : b.v[i];      \
+        }                                                    \
+        return r;                                            \
+    }
+
+#endif
+
+#define CARP_SIMD_LANE(x, i) ((x).v[i])
+
+#ifndef OPTIMIZE
+#define CARP_SIMD_CHECK_LANE(i, N) assert((i) >= 0 && (i) < (N))
+#define CARP_SIMD_CHECK_RANGE(a, i, N) \
+    assert((i) >= 0);                  \
+    assert((size_t)(i) + (N) <= (a)->len)
+#else
+#define CARP_SIMD_CHECK_LANE(i, N)
+#define CARP_SIMD_CHECK_RANGE(a, i, N)
+#endif
+
+/* Everything that is written the same way for both representations. The
+ * reductions go through the lanes in order, which the compiler turns into
+ * shuffles for the native types. */
+#define CARP_SIMD_DEFINE(T, M, E, N, FMT)                                     \
+    CARP_SIMD_BINARY(T, M, N, add, +)                                         \
+    CARP_SIMD_BINARY(T, M, N, sub, -)                                         \
+    CARP_SIMD_BINARY(T, M, N, mul, *)                                         \
+    CARP_SIMD_BINARY(T, M, N, div, /)                                         \
+    CARP_SIMD_SELECT(T, M, N, min, <)                                         \
+    CARP_SIMD_SELECT(T, M, N, max, >)                                         \
+    CARP_SIMD_COMPARE(T, M, N, lt_MINUS_mask, <)                              \
+    CARP_SIMD_COMPARE(T, M, N, gt_MINUS_mask, >)                              \
+    CARP_SIMD_COMPARE(T, M, N, eq_MINUS_mask, ==)                             \
+    CARP_SIMD_BLEND(T, M, N)                                                  \
+                                                                              \
+    static inline T T##_splat(E x) {                                          \
+        T r;                                                                  \
+        for (int i = 0; i < N; i++) {                                         \
+            CARP_SIMD_LANE(r, i) = x;                                         \
+        }                                                                     \
+        return r;                                                             \
+    }                                                                         \
+                                                                              \
+    static inline E T##_lane(T x, int i) {                                    \
+        CARP_SIMD_CHECK_LANE(i, N);                                           \
+        return CARP_SIMD_LANE(x, i);                                          \
+    }                                                                         \
+                                                                              \
+    static inline T T##_set_MINUS_lane(T x, int i, E e) {                     \
+        CARP_SIMD_CHECK_LANE(i, N);                                           \
+        CARP_SIMD_LANE(x, i) = e;                                             \
+        return x;                                                             \
+    }                                                                         \
+                                                                              \
+    static inline E T##_sum(T x) {                                            \
+        E r = CARP_SIMD_LANE(x, 0);                                           \
+        for (int i = 1; i < N; i++) {                                         \
+            r += CARP_SIMD_LANE(x, i);                                        \
+        }                                                                     \
+        return r;                                                             \
+    }                                                                         \
+                                                                              \
+    static inline E T##_minimum(T x) {                                        \
+        E r = CARP_SIMD_LANE(x, 0);                                           \
+        for (int i = 1; i < N; i++) {                                         \
+            r = CARP_SIMD_LANE(x, i) < r ? CARP_SIMD_LANE(x, i) : r;          \
+        }                                                                     \
+        return r;                                                             \
+    }                                                                         \
+                                                                              \
+    static inline E T##_maximum(T x) {                                        \
+        E r = CARP_SIMD_LANE(x, 0);                                           \
+        for (int i = 1; i < N; i++) {                                         \
+            r = CARP_SIMD_LANE(x, i) > r ? CARP_SIMD_LANE(x, i) : r;          \
+        }                                                                     \
+        return r;                                                             \
+    }                                                                         \
+                                                                              \
+    /* memcpy because the element at i has no particular alignment. */       \
+    static inline T T##_load(Array *a, int i) {                               \
+        CARP_SIMD_CHECK_RANGE(a, i, N);                                       \
+        T r;                                                                  \
+        memcpy(&r, (E *)a->data + i, sizeof(T));                              \
+        return r;                                                             \
+    }                                                                         \
+                                                                              \
+    static inline void T##_store_BANG_(Array *a, int i, T x) {                \
+        CARP_SIMD_CHECK_RANGE(a, i, N);                                       \
+        memcpy((E *)a->data + i, &x, sizeof(T));                              \
+    }                                                                         \
+                                                                              \
+    static inline bool T##__EQ_(T a, T b) {                                   \
+        return T##_eq_MINUS_mask(a, b) == (1 << N) - 1;                       \
+    }                                                                         \
+                                                                              \
+    static inline T T##_copy(T *x) {                                          \
+        return *x;                                                            \
+    }                                                                         \
+                                                                              \
+    String T##_str(T x) {                                                     \
+        int size = snprintf(NULL, 0, "(" #T) + 2;                             \
+        for (int i = 0; i < N; i++) {                                         \
+            size += snprintf(NULL, 0, " " FMT, CARP_SIMD_LANE(x, i));         \
+        }                                                                     \
+        String buffer = CARP_MALLOC(size);                                    \
+        int n = sprintf(buffer, "(" #T);                                      \
+        for (int i = 0; i < N; i++) {                                         \
+            n += sprintf(buffer + n, " " FMT, CARP_SIMD_LANE(x, i));          \
+        }                                                                     \
+        sprintf(buffer + n, ")");                                             \
+        return buffer;                                                        \
+    }
+
+CARP_SIMD_DEFINE(F32x4, Simd_internal_mask_F32x4, float, 4, "%gf")
+CARP_SIMD_DEFINE(F64x4, Simd_internal_mask_F64x4, double, 4, "%g")
+CARP_SIMD_DEFINE(I32x8, Simd_internal_mask_I32x8, int, 8, "%d")
+
+static inline F32x4 F32x4_init(float a, float b, float c, float d) {
+    F32x4 r;
+    CARP_SIMD_LANE(r, 0) = a;
+    CARP_SIMD_LANE(r, 1) = b;
+    CARP_SIMD_LANE(r, 2) = c;
+    CARP_SIMD_LANE(r, 3) = d;
+    return r;
+}
+
+static inline F64x4 F64x4_init(double a, double b, double c, double d) {
+    F64x4 r;
+    CARP_SIMD_LANE(r, 0) = a;
+    CARP_SIMD_LANE(r, 1) = b;
+    CARP_SIMD_LANE(r, 2) = c;
+    CARP_SIMD_LANE(r, 3) = d;
+    return r;
+}
+
+static inline I32x8 I32x8_init(int a, int b, int c, int d, int e, int f, int g, int h) {
+    I32x8 r;
+    CARP_SIMD_LANE(r, 0) = a;
+    CARP_SIMD_LANE(r, 1) = b;
+    CARP_SIMD_LANE(r, 2) = c;
+    CARP_SIMD_LANE(r, 3) = d;
+    CARP_SIMD_LANE(r, 4) = e;
+    CARP_SIMD_LANE(r, 5) = f;
+    CARP_SIMD_LANE(r, 6) = g;
+    CARP_SIMD_LANE(r, 7) = h;
+    return r;
+}
+
+bool Simd_native_QMARK_() {
+#ifdef CARP_SIMD_NATIVE
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+/* Bucket arithmetic for Statistics.Histogram. Values below 2^bits get a
+ * bucket each; above that, every power of two is split into 2^(bits - 1)
+ * equally wide buckets, so a bucket is never wider than 2^-(bits - 1) times
+ * its lower bound. */
+
+static inline int Statistics_internal_highest_bit(long v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzl((unsigned long)v);
+#else
+    int bit = 0;
+    while (v >>= 1) {
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+int Statistics_internal_histogram_buckets(int bits) {
+    return (1 << bits) + (63 - bits) * (1 << (bits - 1));
+}
+
+int Statistics_internal_histogram_index(long v, int bits) {
+    if (v < (1l << bits)) {
+        return v < 0 ? 0 : (int)v;
+    }
+    int half = 1 << (bits - 1);
+    int shift = Statistics_internal_highest_bit(v) - (bits - 1);
+    int top = (int)(v >> shift);
+    return (1 << bits) + (shift - 1) * half + (top - half);
+}
+
+long Statistics_internal_histogram_lower_bound(int index, int bits) {
+    if (index < (1 << bits)) {
+        return index;
+    }
+    int half = 1 << (bits - 1);
+    int j = index - (1 << bits);
+    int shift = j / half + 1;
+    long top = j % half + half;
+    return top << shift;
+}
+
+long Statistics_internal_histogram_upper_bound(int index, int bits) {
+    if (index < (1 << bits)) {
+        return index;
+    }
+    int half = 1 << (bits - 1);
+    int shift = (index - (1 << bits)) / half + 1;
+    return Statistics_internal_histogram_lower_bound(index, bits) + (1l << shift) - 1;
+}
@@ -1,7 +1,9 @@
 #pragma once
 #include <string.h>
 
+#include <carp_format.h>
 #include <carp_memory.h>
+#include <carp_parse.h>
 #include <core.h>
 
 String String_allocate(int len, char byte) {
@@ -212,10 +214,9 @@ String Char_format(String* str, char b) {
 }
 
 String Double_str(double x) {
-    int size = snprintf(NULL, 0, "%g", x)+1;
-    String buffer = CARP_MALLOC(size);
-    snprintf(buffer, size, "%g", x);
-    return buffer;
+    Array b = Format_buffer(32);
+    Double_str_MINUS_into(&b, x);
+    return Format_to_MINUS_string(b);
 }
 
 String Double_format(String* s, double x) {
@@ -226,10 +227,9 @@ String Double_format(String* s, double x) {
 }
 
 String Float_str(float x) {
-    int size = snprintf(NULL, 0, "%gf", x)+1;
-    String buffer = CARP_MALLOC(size);
-    snprintf(buffer, size, "%gf", x);
-    return buffer;
+    Array b = Format_buffer(32);
+    Float_str_MINUS_into(&b, x);
+    return Format_to_MINUS_string(b);
 }
 
 String Float_format(String* str, float x) {
@@ -240,9 +240,11 @@ String Float_format(String* str, float x) {
 }
 
 String Int_str(int x) {
-    int size = snprintf(NULL, 0, "%d", x)+1;
-    String buffer = CARP_MALLOC(size);
-    snprintf(buffer, size, "%d", x);
+    char digits[11];
+    int n = Format_internal_write_i64(digits, x);
+    String buffer = CARP_MALLOC(n+1);
+    memcpy(buffer, digits, n);
+    buffer[n] = '\0';
     return buffer;
 }
 
@@ -253,14 +255,13 @@ String Int_format(String* str, int x) {
     return buffer;
 }
 
-int Int_from_MINUS_string(String *s) {
-    return atoi(*s);
-}
-
 String Long_str(long x) {
-    int size = snprintf(NULL, 0, "%ldl", x)+1;
-    String buffer = CARP_MALLOC(size);
-    snprintf(buffer, size, "%ldl", x);
+    char digits[20];
+    int n = Format_internal_write_i64(digits, x);
+    String buffer = CARP_MALLOC(n+2);
+    memcpy(buffer, digits, n);
+    buffer[n] = 'l';
+    buffer[n+1] = '\0';
     return buffer;
 }
 
@@ -271,10 +272,6 @@ String Long_format(String* str, long x) {
     return buffer;
 }
 
-long Long_from_MINUS_string(String *s) {
-    return atol(*s);
-}
-
 int String_index_MINUS_of_MINUS_from(String *s, char c, int i) {
     /* Return index of first occurrence of `c` in `s` AFTER index i
      * Returns -1 if not found
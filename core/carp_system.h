@@ -1,3 +1,4 @@
+#pragma once
 #include <time.h>
 
 #ifndef _WIN32
@@ -23,7 +24,7 @@ void System_sleep_MINUS_micros(int t) {
     // TODO!
 }
 
-double System_nanotime() {
+long System_nanotime() {
     return 0;
 }
 #else
@@ -35,10 +36,12 @@ void System_sleep_MINUS_micros(int t) {
     usleep(t);
 }
 
-double System_nanotime() {
+/* A monotonic clock: durations and deadlines measured with it aren't thrown
+ * off when the wall clock is set. */
+long System_nanotime() {
   struct timespec tv;
-  clock_gettime(CLOCK_REALTIME, &tv);
-  return 1000000000 * tv.tv_sec + tv.tv_nsec;
+  clock_gettime(CLOCK_MONOTONIC, &tv);
+  return 1000000000L * tv.tv_sec + tv.tv_nsec;
 }
 #endif
 
@@ -0,0 +1,234 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include <core.h>
+#include <carp_system.h>
+
+/* Spans recorded by `trace-span`. Every thread writes complete spans (name,
+ * start, duration) into its own ring buffer, so recording takes no lock;
+ * when a buffer is full the oldest spans are overwritten. The buffers are
+ * linked into a global list the first time a thread records a span, and
+ * are written as Chrome trace JSON (chrome://tracing, Perfetto) at exit and
+ * on SIGUSR1, to CARP_TRACE_OUTPUT or "trace.json".
+ *
+ * With -D CARP_NO_TRACE all of this compiles to nothing. */
+
+#ifndef CARP_TRACE_EVENTS
+#define CARP_TRACE_EVENTS 16384
+#endif
+
+#define CARP_TRACE_NAME 40
+
+#ifdef CARP_NO_TRACE
+
+static inline long Trace_start() {
+    return 0;
+}
+
+static inline void Trace_record(String *name, long start) {
+    (void)name;
+    (void)start;
+}
+
+static inline void Trace_dump() {
+}
+
+static inline bool Trace_enabled_QMARK_() {
+    return false;
+}
+
+#else
+
+typedef struct {
+    char name[CARP_TRACE_NAME];
+    long start;
+    long duration;
+} Trace_internal_event;
+
+typedef struct Trace_internal_buffer {
+    struct Trace_internal_buffer *next;
+    long thread;
+    long count;
+    Trace_internal_event events[CARP_TRACE_EVENTS];
+} Trace_internal_buffer;
+
+Trace_internal_buffer *Trace_internal_buffers = NULL;
+long Trace_internal_threads = 0;
+_Thread_local Trace_internal_buffer *Trace_internal_own_buffer = NULL;
+
+/* The output path, looked up before the signal handler is installed,
+ * because getenv isn't safe to call from it. Empty until then. */
+char Trace_internal_path[4096] = "";
+
+static void Trace_internal_resolve_path() {
+    if (Trace_internal_path[0] != '\0') {
+        return;
+    }
+    const char *path = getenv("CARP_TRACE_OUTPUT");
+    if (!path || strlen(path) >= sizeof(Trace_internal_path)) {
+        path = "trace.json";
+    }
+    strcpy(Trace_internal_path, path);
+}
+
+void Trace_dump();
+void Trace_internal_write();
+
+#ifndef _WIN32
+void Trace_internal_on_signal(int signal) {
+    (void)signal;
+    Trace_internal_write();
+}
+#endif
+
+Trace_internal_buffer *Trace_internal_register() {
+    /* Not CARP_MALLOC: the buffers live until exit and aren't part of the
+     * memory balance of the program. */
+    Trace_internal_buffer *buffer = malloc(sizeof(Trace_internal_buffer));
+    buffer->count = 0;
+    buffer->thread = __atomic_add_fetch(&Trace_internal_threads, 1, __ATOMIC_RELAXED);
+    if (buffer->thread == 1) {
+        Trace_internal_resolve_path();
+        atexit(Trace_dump);
+#ifndef _WIN32
+        signal(SIGUSR1, Trace_internal_on_signal);
+#endif
+    }
+    buffer->next = __atomic_load_n(&Trace_internal_buffers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&Trace_internal_buffers, &buffer->next, buffer, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    Trace_internal_own_buffer = buffer;
+    return buffer;
+}
+
+long Trace_start() {
+    return System_nanotime();
+}
+
+void Trace_record(String *name, long start) {
+    long end = System_nanotime();
+    Trace_internal_buffer *buffer = Trace_internal_own_buffer;
+    if (!buffer) {
+        buffer = Trace_internal_register();
+    }
+    Trace_internal_event *event = &buffer->events[buffer->count % CARP_TRACE_EVENTS];
+    strncpy(event->name, *name, CARP_TRACE_NAME - 1);
+    event->name[CARP_TRACE_NAME - 1] = '\0';
+    event->start = start;
+    event->duration = end > start ? end - start : 0;
+    __atomic_store_n(&buffer->count, buffer->count + 1, __ATOMIC_RELEASE);
+}
+
+static char *Trace_internal_append(char *p, const char *s) {
+    while (*s) {
+        *p++ = *s++;
+    }
+    return p;
+}
+
+static char *Trace_internal_append_long(char *p, long v) {
+    char digits[20];
+    int n = 0;
+    unsigned long u = v < 0 ? 0 - (unsigned long)v : (unsigned long)v;
+    do {
+        digits[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (v < 0) {
+        *p++ = '-';
+    }
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+/* Nanoseconds as microseconds with three decimals. */
+static char *Trace_internal_append_micros(char *p, long nanos) {
+    p = Trace_internal_append_long(p, nanos / 1000);
+    long fraction = nanos % 1000;
+    fraction = fraction < 0 ? -fraction : fraction;
+    *p++ = '.';
+    *p++ = (char)('0' + fraction / 100);
+    *p++ = (char)('0' + fraction / 10 % 10);
+    *p++ = (char)('0' + fraction % 10);
+    return p;
+}
+
+/* Writes the spans to the path looked up beforehand, with only
+ * async-signal-safe calls (open, write and close, and formatting by hand)
+ * so that it can run in the SIGUSR1 handler. Timestamps are microseconds. */
+void Trace_internal_write() {
+    if (Trace_internal_path[0] == '\0') {
+        return;
+    }
+#ifdef _WIN32
+    FILE *file = fopen(Trace_internal_path, "w");
+    if (!file) {
+        return;
+    }
+#define CARP_TRACE_WRITE(s, n) fwrite((s), 1, (n), file)
+#else
+    int fd = open(Trace_internal_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return;
+    }
+#define CARP_TRACE_WRITE(s, n) (void)!write(fd, (s), (n))
+#endif
+    const char header[] = "{\"traceEvents\":[\n";
+    CARP_TRACE_WRITE(header, sizeof(header) - 1);
+    bool first = true;
+    char line[256];
+    Trace_internal_buffer *buffer = __atomic_load_n(&Trace_internal_buffers, __ATOMIC_ACQUIRE);
+    for (; buffer; buffer = buffer->next) {
+        long count = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+        long from = count > CARP_TRACE_EVENTS ? count - CARP_TRACE_EVENTS : 0;
+        for (long i = from; i < count; i++) {
+            Trace_internal_event *event = &buffer->events[i % CARP_TRACE_EVENTS];
+            char *p = Trace_internal_append(line, first ? "{\"name\":\"" : ",\n{\"name\":\"");
+            for (const char *c = event->name; *c; c++) {
+                if (*c == '"' || *c == '\\') {
+                    *p++ = '\\';
+                }
+                *p++ = (unsigned char)*c < ' ' ? ' ' : *c;
+            }
+            p = Trace_internal_append(p, "\",\"ph\":\"X\",\"ts\":");
+            p = Trace_internal_append_micros(p, event->start);
+            p = Trace_internal_append(p, ",\"dur\":");
+            p = Trace_internal_append_micros(p, event->duration);
+            p = Trace_internal_append(p, ",\"pid\":1,\"tid\":");
+            p = Trace_internal_append_long(p, buffer->thread);
+            *p++ = '}';
+            CARP_TRACE_WRITE(line, p - line);
+            first = false;
+        }
+    }
+    const char footer[] = "\n]}\n";
+    CARP_TRACE_WRITE(footer, sizeof(footer) - 1);
+#undef CARP_TRACE_WRITE
+#ifdef _WIN32
+    fclose(file);
+#else
+    close(fd);
+#endif
+}
+
+void Trace_dump() {
+    Trace_internal_resolve_path();
+    Trace_internal_write();
+}
+
+bool Trace_enabled_QMARK_() {
+    return true;
+}
+
+#endif
@@ -6,6 +6,7 @@
 #endif
 #include "carp_stdbool.h"
 #include <stddef.h>
+#include <string.h>
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
 #include <windows.h>
 #endif
@@ -37,4 +38,6 @@ bool not(bool b) {
 bool and(bool x, bool y) { return x && y; }
 bool or(bool x, bool y) { return x || y; }
 
+#include "carp_profile.h"
+
 #endif
@@ -26,6 +26,7 @@ stack install;
 ./test/execute.sh ./examples/maps.carp
 ./test/execute.sh ./examples/lambdas.carp
 ./test/execute.sh ./examples/sumtypes.carp
+./test/execute.sh ./examples/assert_no_alloc.carp
 
 # Actual tests (using the test suite)
 for f in ./test/*.carp; do
@@ -13,6 +13,7 @@ import ToTemplate
 import Polymorphism
 import Concretize
 import Lookup
+import StructUtils
 
 -- | "Endofunctor Map"
 templateEMap :: (String, Binder)
@@ -40,7 +41,7 @@ templateShrinkCheck :: String -> String
 templateShrinkCheck var =
   unlines [ "    if(" ++ var ++ ".len < (" ++ var ++ ".capacity / 4)) {"
           ,"        " ++ var ++ ".capacity = " ++ var ++ ".len * 2;"
-          ,"        " ++ var ++ ".data = realloc(" ++ var ++ ".data, sizeof($a) * " ++ var ++ " .capacity);"
+          ,"        " ++ var ++ ".data = CARP_REALLOC(" ++ var ++ ".data, sizeof($a) * " ++ var ++ " .capacity);"
           , "    }"
           ]
 
@@ -92,7 +93,7 @@ templatePushBack =
         ,"    a.len++;"
         ,"    if(a.len > a.capacity) {"
         ,"        a.capacity = a.len * 2;"
-        ,"        a.data = realloc(a.data, sizeof($a) * a.capacity);"
+        ,"        a.data = CARP_REALLOC(a.data, sizeof($a) * a.capacity);"
         -- ,"        void *pre = a.data;"
         -- ,"        a.data = CARP_MALLOC(sizeof($a) * a.capacity);"
         -- ,"        unsigned long s = sizeof($a) * (a.len - 1);"
@@ -118,7 +119,7 @@ templatePushBackBang =
         ,"    aRef->len++;"
         ,"    if(aRef->len > aRef->capacity) {"
         ,"        aRef->capacity = aRef->len * 2;"
-        ,"        aRef->data = realloc(aRef->data, sizeof($a) * aRef->capacity);"
+        ,"        aRef->data = CARP_REALLOC(aRef->data, sizeof($a) * aRef->capacity);"
         ,"    }"
         ,"    (($a*)aRef->data)[aRef->len - 1] = value;"
         ,"}"
@@ -268,6 +269,25 @@ templateAsetUninitializedBang = defineTypeParameterizedTemplate templateCreator
                                          ,"}"]))
             (const [])
 
+-- | Puts a new value at location 'n' and returns the one that was there, moving it out of the
+-- | array rather than copying it.
+templateReplaceBang :: (String, Binder)
+templateReplaceBang = defineTemplate
+  (SymPath ["Array"] "replace!")
+  (FuncTy [RefTy (StructTy "Array" [VarTy "t"]), IntTy, VarTy "t"] (VarTy "t"))
+  (toTemplate "$t $NAME (Array *aRef, int n, $t newValue)")
+  (toTemplate $ unlines ["$DECL {"
+                        ,"    Array a = *aRef;"
+                        ,"    #ifndef OPTIMIZE"
+                        ,"    assert(n >= 0);"
+                        ,"    assert(n < a.len);"
+                        ,"    #endif"
+                        ,"    $t oldValue = (($t*)a.data)[n];"
+                        ,"    (($t*)a.data)[n] = newValue;"
+                        ,"    return oldValue;"
+                        ,"}"])
+  (const [])
+
 templateLength :: (String, Binder)
 templateLength = defineTypeParameterizedTemplate templateCreator path t
   where path = (SymPath ["Array"] "length")
@@ -319,7 +339,11 @@ templateDeleteArray = defineTypeParameterizedTemplate templateCreator path t
                 depsForDeleteFunc typeEnv env insideType)
 
 deleteTy :: TypeEnv -> Env -> Ty -> [Token]
-deleteTy typeEnv env (StructTy "Array" [innerType]) =
+deleteTy typeEnv env (StructTy "Array" [innerType])
+  | not (isManaged typeEnv innerType) =
+  [ TokC   "    CARP_FREE(a.data);\n"
+  ]
+  | otherwise =
   [ TokC   "    for(int i = 0; i < a.len; i++) {\n"
   , TokC $ "    " ++ insideArrayDeletion typeEnv env innerType "i"
   , TokC   "    }\n"
@@ -378,7 +402,11 @@ templateCopyArray = defineTypeParameterizedTemplate templateCreator path t
                    error ("CAN'T MATCH: " ++ show err))
 
 copyTy :: TypeEnv -> Env -> Ty -> [Token]
-copyTy typeEnv env (StructTy "Array" [innerType]) =
+copyTy typeEnv env (StructTy "Array" [innerType])
+  | isTriviallyCopyable typeEnv innerType =
+  [ TokC   "    memcpy(copy.data, a->data, sizeof(", TokTy innerType Normal, TokC ") * a->len);\n"
+  ]
+  | otherwise =
   [ TokC   "    for(int i = 0; i < a->len; i++) {\n"
   , TokC $ "    " ++ insideArrayCopying typeEnv env innerType
   , TokC   "    }\n"
@@ -416,57 +444,39 @@ strTy :: TypeEnv -> Env -> Ty -> [Token]
 strTy typeEnv env (StructTy "Array" [innerType]) =
   [ TokC   ""
   , TokC   "  String temp = NULL;\n"
-  , TokC $ calculateStrSize typeEnv env innerType
-  , TokC   "  String buffer = CARP_MALLOC(size);\n"
-  , TokC   "  String bufferPtr = buffer;\n"
+  , TokC   "  (void)temp;\n"
+  , TokC   "  Array b = Format_buffer(2 + 8 * a->len);\n"
   , TokC   "\n"
-  , TokC   "  snprintf(buffer, size, \"[\");\n"
-  , TokC   "  bufferPtr += 1;\n"
+  , TokC   "  Format_internal_append(&b, \"[\", 1);\n"
   , TokC   "\n"
   , TokC   "  for(int i = 0; i < a->len; i++) {\n"
   , TokC $ "  " ++ insideArrayStr typeEnv env innerType
   , TokC   "  }\n"
   , TokC   "\n"
-  , TokC   "  if(a->len > 0) { bufferPtr -= 1; }\n"
-  , TokC   "  snprintf(bufferPtr, size, \"]\");\n"
-  , TokC   "  return buffer;\n"
+  , TokC   "  if(a->len > 0) { b.len -= 1; }\n"
+  , TokC   "  Format_internal_append(&b, \"]\", 1);\n"
+  , TokC   "  return Format_to_MINUS_string(b);\n"
   ]
 strTy _ _ _ = []
 
-calculateStrSize :: TypeEnv -> Env -> Ty -> String
-calculateStrSize typeEnv env t =
-  unlines [ "  int size = 3; // opening and closing brackets and terminator"
-          , "  for(int i = 0; i < a->len; i++) {"
-          , arrayMemberSizeCalc ++ "  }"
-          , ""
-          ]
-  where arrayMemberSizeCalc =
-          case findFunctionForMemberIncludePrimitives typeEnv env "prn" (typesStrFunctionType typeEnv t) ("Inside array.", t) of
-              FunctionFound functionFullName ->
-                let takeAddressOrNot = if isManaged typeEnv t then "&" else ""
-                in  unlines [ "    temp = " ++ functionFullName ++ "(" ++ takeAddressOrNot ++ "((" ++ tyToC t ++ "*)a->data)[i]);"
-                            , "    size += snprintf(NULL, 0, \"%s \", temp);"
-                            , "    if(temp) {"
-                            , "      CARP_FREE(temp);"
-                            , "      temp = NULL;"
-                            , "    }"
-                            ]
-              FunctionNotFound msg -> error msg
-              FunctionIgnored -> "    /* Ignore type inside Array: '" ++ show t ++ "' ??? */\n"
-
-
 insideArrayStr :: TypeEnv -> Env -> Ty -> String
 insideArrayStr typeEnv env t =
-  case findFunctionForMemberIncludePrimitives typeEnv env "prn" (typesStrFunctionType typeEnv t) ("Inside array.", t) of
-    FunctionFound functionFullName ->
-      let takeAddressOrNot = if isManaged typeEnv t then "&" else ""
-      in  unlines [ "  temp = " ++ functionFullName ++ "(" ++ takeAddressOrNot ++ "((" ++ tyToC t ++ "*)a->data)[i]);"
-                  , "    snprintf(bufferPtr, size, \"%s \", temp);"
-                  , "    bufferPtr += strlen(temp) + 1;"
-                  , "    if(temp) {"
-                  , "      CARP_FREE(temp);"
-                  , "      temp = NULL;"
-                  , "    }"
-                  ]
-    FunctionNotFound msg -> error msg
-    FunctionIgnored -> "    /* Ignore type inside Array: '" ++ show t ++ "' ??? */\n"
+  case primitiveStrInto t of
+    Just strIntoFunction ->
+      unlines [ "  " ++ strIntoFunction ++ "(&b, ((" ++ tyToC t ++ "*)a->data)[i]);"
+              , "    Format_internal_append(&b, \" \", 1);"
+              ]
+    Nothing ->
+      case findFunctionForMemberIncludePrimitives typeEnv env "prn" (typesStrFunctionType typeEnv t) ("Inside array.", t) of
+        FunctionFound functionFullName ->
+          let takeAddressOrNot = if isManaged typeEnv t then "&" else ""
+          in  unlines [ "  temp = " ++ functionFullName ++ "(" ++ takeAddressOrNot ++ "((" ++ tyToC t ++ "*)a->data)[i]);"
+                      , "    Format_internal_append(&b, temp, strlen(temp));"
+                      , "    Format_internal_append(&b, \" \", 1);"
+                      , "    if(temp) {"
+                      , "      CARP_FREE(temp);"
+                      , "      temp = NULL;"
+                      , "    }"
+                      ]
+        FunctionNotFound msg -> error msg
+        FunctionIgnored -> "    /* Ignore type inside Array: '" ++ show t ++ "' ??? */\n"
@@ -5,11 +5,12 @@ import System.Info (os)
 import Control.Monad.State
 import Control.Monad.State.Lazy (StateT(..), runStateT, liftIO, modify, get, put)
 import Data.Maybe (fromMaybe)
-import Data.List (elemIndex)
+import Data.List (elemIndex, isInfixOf, stripPrefix)
+import Data.Char (isSpace)
 import System.Exit (exitSuccess, exitFailure, exitWith, ExitCode(..))
-import System.FilePath (takeDirectory)
+import System.FilePath (takeDirectory, isAbsolute, (</>))
 import qualified Data.Map as Map
-import System.Process (callCommand, spawnCommand, waitForProcess)
+import System.Process (callCommand, spawnCommand, waitForProcess, readCreateProcessWithExitCode, shell)
 import Control.Exception
 
 import Parsing
@@ -143,6 +144,18 @@ commandProjectConfig [xobj@(XObj (Str key) _ _), value] =
                                       return (proj { projectDocsURL = url })
                      "docs-styling" -> do url <- unwrapStringXObj value
                                           return (proj { projectDocsStyling = url })
+                     "skip-identical-builds" -> do skip <- unwrapBoolXObj value
+                                                   return (proj { projectSkipIdenticalBuilds = skip })
+                     "lto" -> do lto <- unwrapBoolXObj value
+                                 return (proj { projectLto = lto })
+                     "march" -> do march <- unwrapStringXObj value
+                                   return (proj { projectMarch = march })
+                     "pgo" -> do pgo <- unwrapStringXObj value
+                                 case pgo of
+                                   "off" -> return (proj { projectPgo = NoPgo })
+                                   "generate" -> return (proj { projectPgo = PgoGenerate })
+                                   "use" -> return (proj { projectPgo = PgoUse })
+                                   _ -> Left ("Project.config can't understand the value '" ++ pgo ++ "' for key 'pgo'.")
                      "file-path-print-length" -> do length <- unwrapStringXObj value
                                                     case length of
                                                       "short" -> return (proj { projectFilePathPrintLength = ShortPath })
@@ -182,6 +195,10 @@ commandProjectGetConfig [xobj@(XObj (Str key) _ _)] =
           "docs-url" -> Right $ Str $ projectDocsURL proj
           "docs-styling" -> Right $ Str $ projectDocsStyling proj
           "file-path-print-length" -> Right $ Str $ show (projectFilePathPrintLength proj)
+          "skip-identical-builds" -> Right $ Bol $ projectSkipIdenticalBuilds proj
+          "lto" -> Right $ Bol $ projectLto proj
+          "march" -> Right $ Str $ projectMarch proj
+          "pgo" -> Right $ Str $ show (projectPgo proj)
           _ ->
             Left $ EvalError ("[CONFIG ERROR] Project.get-config can't understand the key '" ++ key) (info xobj)
 commandProjectGetConfig [faultyKey] =
@@ -242,31 +259,156 @@ commandBuild shutUp args =
                          (show err))
                         Nothing))
        Right okSrc ->
-         do let compiler = projectCompiler proj
-                echoCompilationCommand = projectEchoCompilationCommand proj
+         do clang <- liftIO $ if projectPgo proj == NoPgo
+                                then return False
+                                else compilerIsClang (projectCompiler proj)
+            let compiler = projectCompiler proj
                 incl = projectIncludesToC proj
                 includeCorePath = " -I" ++ projectCarpDir proj ++ "/core/ "
-                flags = includeCorePath ++ projectFlags proj
+                flags = includeCorePath ++ projectFlags proj ++ optimizationFlags proj clang outDir
                 outDir = projectOutDir proj ++ pathSeparator
                 outMain = outDir ++ "main.c"
                 outExe = outDir ++ projectTitle proj
                 outLib = outDir ++ projectTitle proj
             liftIO $ createDirectoryIfMissing False outDir
-            liftIO $ writeFile outMain (incl ++ okSrc)
+            liftIO $ preparePgo proj clang outDir
             case Map.lookup "main" (envBindings env) of
               Just _ -> do let cmd = compiler ++ " " ++ outMain ++ " -o \"" ++ outExe ++ "\" " ++ flags
-                           liftIO $ do when echoCompilationCommand (putStrLn cmd)
-                                       callCommand cmd
-                                       when (execMode == Repl && not shutUp) (putStrLn ("Compiled to '" ++ outExe ++ "' (executable)"))
+                           liftIO $ do compiled <- compileUnlessIdentical proj outMain (incl ++ okSrc) outExe cmd
+                                       when (execMode == Repl && not shutUp)
+                                         (putStrLn ((if compiled then "Compiled to '" else "Up to date: '") ++ outExe ++ "' (executable)"))
                            setProjectCanExecute True
                            return dynamicNil
               Nothing -> do let cmd = compiler ++ " " ++ outMain ++ " -shared -o \"" ++ outLib ++ "\" " ++ flags
-                            liftIO $ do when echoCompilationCommand (putStrLn cmd)
-                                        callCommand cmd
-                                        when (execMode == Repl && not shutUp) (putStrLn ("Compiled to '" ++ outLib ++ "' (shared library)"))
+                            liftIO $ do compiled <- compileUnlessIdentical proj outMain (incl ++ okSrc) outLib cmd
+                                        when (execMode == Repl && not shutUp)
+                                          (putStrLn ((if compiled then "Compiled to '" else "Up to date: '") ++ outLib ++ "' (shared library)"))
                             setProjectCanExecute False
                             return dynamicNil
 
+-- | The flags for profile guided optimization, link time optimization and the target architecture.
+-- | Profiles are kept in the 'pgo' directory inside of the output directory (merged into 'pgo.profdata' for clang).
+-- | Both phases of a PGO build compile with -O3, however the phase was set.
+optimizationFlags :: Project -> Bool -> FilePath -> String
+optimizationFlags proj clang outDir =
+  concatMap (" " ++) (pgoFlags ++ ltoFlags ++ marchFlags)
+  where pgoDir = outDir ++ "pgo"
+        pgoOptimize = if "-O3" `isInfixOf` projectFlags proj then [] else ["-O3"]
+        pgoFlags = case projectPgo proj of
+                     NoPgo -> []
+                     PgoGenerate -> pgoOptimize ++ ["-fprofile-generate=\"" ++ pgoDir ++ "\""]
+                     PgoUse | clang -> pgoOptimize ++ ["-fprofile-use=\"" ++ outDir ++ "pgo.profdata\""]
+                            | otherwise -> pgoOptimize ++ ["-fprofile-use=\"" ++ pgoDir ++ "\"", "-fprofile-correction"]
+        ltoFlags = if projectLto proj then ["-flto"] else []
+        marchFlags = if projectMarch proj == "" then [] else ["-march=" ++ projectMarch proj]
+
+-- | Finds a header the way the C compiler does: next to the file that includes it when it is
+-- | included with quotes, then in the include directories.
+findInclude :: [FilePath] -> FilePath -> IO (Maybe FilePath)
+findInclude dirs file
+  | isAbsolute file = do exists <- doesFileExist file
+                         return (if exists then Just file else Nothing)
+  | otherwise = firstExisting (map (</> file) dirs)
+  where firstExisting [] = return Nothing
+        firstExisting (path : rest) = do exists <- doesFileExist path
+                                         if exists then return (Just path) else firstExisting rest
+
+-- | The headers that a C file includes, with whether each was included with quotes.
+includesIn :: String -> [(Bool, FilePath)]
+includesIn = concatMap include . lines
+  where include line =
+          case dropWhile isSpace line of
+            '#' : directive ->
+              case stripPrefix "include" (dropWhile isSpace directive) of
+                Just target -> case dropWhile isSpace target of
+                                 '"' : name -> [(True, takeWhile (/= '"') name)]
+                                 '<' : name -> [(False, takeWhile (/= '>') name)]
+                                 _ -> []
+                Nothing -> []
+            _ -> []
+
+-- | Resolves the headers to visit, each with whether it was included with quotes and the
+-- | directory of the file including it, and the headers they include in turn. Headers that
+-- | aren't in the include directories are system headers, except for those included with
+-- | quotes: the second result is whether all of those were found.
+resolveHeaders :: [FilePath] -> [FilePath] -> [(Bool, FilePath, FilePath)] -> IO ([FilePath], Bool)
+resolveHeaders _ found [] = return (reverse found, True)
+resolveHeaders dirs found ((quoted, from, file) : rest) =
+  do path <- findInclude (if quoted then from : dirs else dirs) file
+     case path of
+       Just p | p `elem` found -> resolveHeaders dirs found rest
+              | otherwise -> do contents <- readFile p
+                                let nested = [(q, takeDirectory p, f) | (q, f) <- includesIn contents]
+                                length contents `seq` resolveHeaders dirs (p : found) (rest ++ nested)
+       Nothing -> do (paths, allFound) <- resolveHeaders dirs found rest
+                     return (paths, allFound && not quoted)
+
+-- | Whether the compiler is clang, whatever it is called (the default 'cc' on macOS is clang).
+-- | Asks the compiler itself, since clang names itself in its version output.
+compilerIsClang :: String -> IO Bool
+compilerIsClang compiler =
+  do result <- try (readCreateProcessWithExitCode (shell (compiler ++ " --version")) "")
+                 :: IO (Either IOException (ExitCode, String, String))
+     return $ case result of
+                Right (ExitSuccess, out, _) -> "clang" `isInfixOf` out
+                _ -> False
+
+-- | Clang writes raw profiles during the training run, they have to be merged before they can be used.
+preparePgo :: Project -> Bool -> FilePath -> IO ()
+preparePgo proj clang outDir =
+  case projectPgo proj of
+    PgoGenerate -> createDirectoryIfMissing False pgoDir
+    PgoUse -> do exists <- doesDirectoryExist pgoDir
+                 if not exists
+                   then throw (ShellOutException ("No profiles found in '" ++ pgoDir ++ "', build with --pgo-generate and run the program first.") 1)
+                   else when clang $
+                          do let cmd = "llvm-profdata merge -output=\"" ++ outDir ++ "pgo.profdata\" \"" ++ pgoDir ++ "\""
+                             when (projectEchoCompilationCommand proj) (putStrLn cmd)
+                             callCommand cmd
+    NoPgo -> return ()
+  where pgoDir = outDir ++ "pgo"
+
+-- | Writes the C source and runs the compiler command, unless 'skip-identical-builds' is on and
+-- | the source, the command and every header that can be resolved are the same as for the
+-- | output that already exists. The hash of those is kept next to the output. Returns whether
+-- | the compiler was run.
+-- | The whole program is one translation unit, so any change at all recompiles all of it.
+compileUnlessIdentical :: Project -> FilePath -> String -> FilePath -> String -> IO Bool
+compileUnlessIdentical proj outMain src out cmd =
+  do let hashFile = out ++ ".hash"
+         coreDir = projectCarpDir proj ++ "/core/"
+         outputDir = takeDirectory outMain
+         includeDirs = coreDir : flagIncludeDirs (words (projectFlags proj))
+         included = map toVisit (projectIncludes proj)
+         toVisit (LocalInclude file) = (True, outputDir, file)
+         toVisit (SystemInclude file) = (False, outputDir, file)
+     (headers, allFound) <- if projectSkipIdenticalBuilds proj
+                            then resolveHeaders includeDirs [] included
+                            else return ([], False)
+     headerContents <- mapM readFile headers
+     let hash = hashString (concat (cmd : src : concat (zipWith (\path contents -> [path, contents]) headers headerContents)))
+     outExists <- doesFileExist out
+     hashExists <- doesFileExist hashFile
+     oldHash <- if hashExists then readFileStrict hashFile else return ""
+     -- A header included with quotes that can't be found can't be hashed, so the output can't
+     -- be trusted. The profile data of a PGO build can change without anything else changing.
+     if projectSkipIdenticalBuilds proj && projectPgo proj /= PgoUse && allFound && outExists && oldHash == hash
+       then return False
+       else do writeFile outMain src
+               when (projectEchoCompilationCommand proj) (putStrLn cmd)
+               callCommand cmd
+               if projectSkipIdenticalBuilds proj
+                 then writeFile hashFile hash
+                 else do stale <- doesFileExist hashFile
+                         when stale (removeFile hashFile)
+               return True
+  where flagIncludeDirs ("-I" : dir : rest) = dir : flagIncludeDirs rest
+        flagIncludeDirs (('-' : 'I' : dir) : rest) = dir : flagIncludeDirs rest
+        flagIncludeDirs (_ : rest) = flagIncludeDirs rest
+        flagIncludeDirs [] = []
+        readFileStrict path = do contents <- readFile path
+                                 length contents `seq` return contents
+
 setProjectCanExecute :: Bool -> StateT Context IO ()
 setProjectCanExecute value =
   do ctx <- get
@@ -364,6 +506,12 @@ commandHelp [XObj (Str "structs") _ _] =
               putStrLn "If you need generic members:"
               putStrLn "(deftype (<name> <type variable 1> ...) [<member> <type>, ...])"
               putStrLn ""
+              putStrLn "If all members are numbers (or other such types), the struct can be copied like a number:"
+              putStrLn "(deftype-pod <name> [<member> <type>, ...])"
+              putStrLn ""
+              putStrLn "To store the members of many structs in one array per member:"
+              putStrLn "(defsoa <name> [<member> <type>, ...])"
+              putStrLn ""
               putStrLn "A type definition will generate the following methods:"
               putStrLn "Getters  (<method-name> (Ref <struct>))"
               putStrLn "Setters  (set-<method-name> <struct> <new-value>)"
@@ -420,6 +568,10 @@ commandHelp [XObj(Str "project") _ _] =
               putStrLn "'echo-c'             - When a form is defined using 'def' or 'defn' its C code will be printed."
               putStrLn "'echo-compiler-cmd'  - When building the project the command for running the C compiler will be printed."
               putStrLn "'print-ast'          - The 'info' command will print the AST for a binding."
+              putStrLn "'skip-identical-builds' - Skip the C compiler when neither the generated code nor any header has changed since the last build."
+              putStrLn "'lto'                - Compile and link with link time optimization."
+              putStrLn "'march'              - The architecture to optimize for, like \"native\" (passed as -march)."
+              putStrLn "'pgo'                - Profile guided optimization: \"off\", \"generate\" or \"use\" (see --pgo-generate)."
               putStrLn ""
               return dynamicNil
 
@@ -452,6 +604,9 @@ commandHelp [] =
               putStrLn "--no-core                        - Don't load the core library."
               putStrLn "--log-memory                     - Enables use of memory logging functions in the Debug module."
               putStrLn "--optimize                       - Removes safety checks and runs the C-compiler with the '-O3' flag."
+              putStrLn "--pgo-generate                   - Build an executable that writes profiles for profile guided optimization."
+              putStrLn "--pgo-use                        - Build with the profiles written by a --pgo-generate build."
+              putStrLn "--profile                        - Link a sampling profiler that writes folded stacks at exit."
               putStrLn "--check                          - Report all errors found in a machine readable way."
               return dynamicNil
 
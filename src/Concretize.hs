@@ -2,7 +2,7 @@ module Concretize where
 
 import Control.Monad.State
 import qualified Data.Map as Map
-import Data.Maybe (fromMaybe, fromJust)
+import Data.Maybe (fromMaybe, fromJust, isJust)
 import qualified Data.Set as Set
 import Data.Set ((\\))
 import Data.List (foldl')
@@ -134,8 +134,8 @@ concretizeXObj allowAmbiguityRoot typeEnv rootEnv visitedDefinitions root =
                  deleteFnTemplate = concreteDeleteTakePtr typeEnv env pairs
                  (deleteFn, deleterDeps) = instantiateTemplate (SymPath [] (environmentTypeName ++ "_delete")) deleteFnTy deleteFnTemplate
 
-                 copyFnTy = typesCopyFunctionType environmentStructTy
-                 copyFnTemplate = concreteCopy typeEnv env pairs
+                 copyFnTy = FuncTy [RefTy environmentStructTy] (PointerTy environmentStructTy)
+                 copyFnTemplate = concreteCopyReturnPtr typeEnv env pairs
                  (copyFn, copyDeps) = instantiateTemplate (SymPath [] (environmentTypeName ++ "_copy")) copyFnTy copyFnTemplate
 
                  -- The type env has to contain the lambdas environment struct for 'concretizeDefinition' to work:
@@ -191,9 +191,40 @@ concretizeXObj allowAmbiguityRoot typeEnv rootEnv visitedDefinitions root =
          mapM_ (concretizeTypeOfXObj typeEnv) args
          f <- visit allowAmbig env func
          a <- fmap sequence (mapM (visit allowAmbig env) args)
-         return $ do okF <- f
-                     okA <- a
-                     return (okF : okA)
+         case (f, a) of
+           (Right okF, Right okA) ->
+             do specializedF <- specializeCall env okF okA
+                return (Right (specializedF : okA))
+           _ ->
+             return $ do okF <- f
+                         okA <- a
+                         return (okF : okA)
+
+    -- | When a global function or a lambda that captures nothing is passed to a higher order
+    -- | function defined in Carp, the call is redirected to a copy of the higher order function
+    -- | that calls the argument directly instead of going through its 'Lambda' struct. That
+    -- | lets the C compiler inline it. The argument is still passed, so the signature,
+    -- | and with it the memory management of the call, stays the same.
+    specializeCall :: Env -> XObj -> [XObj] -> State [XObj] XObj
+    specializeCall env func@(XObj (Sym path (LookupGlobal CarpLand AFunction)) fi (Just funcTy)) args
+      | not (isTypeGeneric funcTy) =
+        do deps <- get
+           case definitionOf deps >>= (`specializeDefinition` args) of
+             Just specialized ->
+               let newPath = getPath specialized
+                   alreadyDefined = any ((== newPath) . getPath) deps || isJust (lookupInEnv newPath env)
+               in do when (not alreadyDefined) $
+                       modify (specialized :)
+                     return (XObj (Sym newPath (LookupGlobal CarpLand AFunction)) fi (Just funcTy))
+             Nothing -> return func
+      where definitionOf deps =
+              case [d | d@(XObj (Lst (XObj Defn _ _ : _)) _ _) <- deps, getPath d == path] of
+                d : _ -> Just d
+                [] -> case lookupInEnv path env of
+                        Just (foundEnv, Binder _ d@(XObj (Lst (XObj Defn _ _ : _)) _ _))
+                          | envIsExternal foundEnv -> Just d
+                        _ -> Nothing
+    specializeCall _ func _ = return func
 
     visitMatchCase :: Bool -> Env -> (XObj, XObj) -> State [XObj] (Either TypeError [XObj])
     visitMatchCase allowAmbig env (lhs, rhs) =
@@ -325,6 +356,78 @@ collectCapturedVars root = removeDuplicates (map toGeneralSymbol (visit root))
       concatMap visit xobjs
     visitArray _ = error "The function 'visitArray' only accepts XObjs with arrays in them."
 
+-- | The copy of a concrete function definition that calls the functions known at compile time
+-- | among 'args' directly, or Nothing if there are none. The copy is named after the callees and
+-- | a hash of the definition, so a definition that changes (in the REPL, say) gets a new copy
+-- | instead of reusing the one made from the old definition.
+specializeDefinition :: XObj -> [XObj] -> Maybe XObj
+specializeDefinition (XObj (Lst [defn@(XObj Defn _ _), nameSymbol, params@(XObj (Arr paramsArr) _ _), body]) di dt@(Just defnTy)) args
+  | length paramsArr == length args && not (isTypeGeneric defnTy) && not (null callees) =
+    Just (setPath (XObj (Lst [defn, nameSymbol, params, newBody]) di dt) newPath)
+  where callees = [ (paramName, callee)
+                  | (XObj (Sym (SymPath [] paramName) _) _ (Just paramTy), arg) <- zip paramsArr args
+                  , isFunctionParameter paramTy
+                  , Just callee <- [knownCallee arg]
+                  , not (bindsName paramName body)
+                  ]
+        SymPath pathStrings name = getPath nameSymbol
+        definitionHash = take 8 (hashString (show defnTy ++ pretty params ++ pretty body))
+        newPath = SymPath pathStrings (name ++ concatMap (\(_, callee) -> "__" ++ pathToC (getPath callee)) callees ++ "__" ++ definitionHash)
+        newBody = foldl' (\b (paramName, callee) -> callDirectly paramName callee b) body callees
+specializeDefinition _ _ = Nothing
+
+-- | Is a parameter of this type called like a function?
+isFunctionParameter :: Ty -> Bool
+isFunctionParameter (FuncTy _ _) = True
+isFunctionParameter (RefTy (FuncTy _ _)) = True
+isFunctionParameter _ = False
+
+-- | If an argument is a function known at compile time, return a symbol that calls it directly.
+knownCallee :: XObj -> Maybe XObj
+knownCallee (XObj (Lst [XObj Ref _ _, target]) _ _) = knownCallee target
+knownCallee callee@(XObj (Sym _ (LookupGlobal _ AFunction)) _ (Just t))
+  | isFunctionType t && not (isTypeGeneric t) = Just callee
+knownCallee (XObj (Lst [XObj (Fn (Just lambdaPath) captures) _ _, _, _]) i (Just t))
+  | Set.null captures && not (isTypeGeneric t) = Just (XObj (Sym lambdaPath (LookupGlobal CarpLand AFunction)) i (Just t))
+knownCallee _ = Nothing
+
+-- | Replace every call of the local function 'name' with a call to 'callee'.
+callDirectly :: String -> XObj -> XObj -> XObj
+callDirectly name callee xobj =
+  case obj xobj of
+    -- Lambdas are lifted to functions of their own and keep calling through their environment:
+    Lst (XObj (Fn _ _) _ _ : _) -> xobj
+    Lst (XObj (Lst [XObj Deref _ _, XObj (Sym (SymPath [] n) (LookupLocal NoCapture)) _ _]) fi ft : args)
+      | n == name -> xobj { obj = Lst (callee { info = fi, ty = ft } : map recur args) }
+    Lst (XObj (Sym (SymPath [] n) (LookupLocal NoCapture)) fi ft : args)
+      | n == name -> xobj { obj = Lst (callee { info = fi, ty = ft } : map recur args) }
+    Lst xobjs -> xobj { obj = Lst (map recur xobjs) }
+    Arr xobjs -> xobj { obj = Arr (map recur xobjs) }
+    _ -> xobj
+  where recur = callDirectly name callee
+
+-- | Does any let binding or match case in this form introduce a variable called 'name', or
+-- | does a 'set!' give it a new value?
+bindsName :: String -> XObj -> Bool
+bindsName name xobj =
+  case obj xobj of
+    Lst [XObj SetBang _ _, variable, value] ->
+      mentionsName name variable || bindsName name value
+    Lst [XObj Let _ _, XObj (Arr bindings) _ _, body] ->
+      any (mentionsName name . fst) (pairwise bindings) || any (bindsName name) (body : bindings)
+    Lst (XObj (Fn _ _) _ _ : _) -> False
+    Lst (XObj Match _ _ : expr : cases) ->
+      any (mentionsName name . fst) (pairwise cases) || any (bindsName name) (expr : cases)
+    Lst xobjs -> any (bindsName name) xobjs
+    Arr xobjs -> any (bindsName name) xobjs
+    _ -> False
+  where mentionsName n x =
+          case obj x of
+            Sym (SymPath _ symName) _ -> symName == n
+            Lst xobjs -> any (mentionsName n) xobjs
+            Arr xobjs -> any (mentionsName n) xobjs
+            _ -> False
+
 -- | Do the signatures match?
 matchingSignature :: Ty -> (Ty, SymPath) -> Bool
 matchingSignature tA (tB, _) = areUnifiable tA tB
@@ -1182,6 +1285,22 @@ concreteCopy typeEnv env memberPairs =
    (\_ -> concatMap (depsOfPolymorphicFunction typeEnv env [] "copy" . typesCopyFunctionType)
                     (filter (isManaged typeEnv) (map snd memberPairs)))
 
+-- | The template for the 'copy' function of a lambda environment, the copy is allocated on the heap.
+concreteCopyReturnPtr :: TypeEnv -> Env -> [(String, Ty)] -> Template
+concreteCopyReturnPtr typeEnv env memberPairs =
+  Template
+   (FuncTy [RefTy (VarTy "p")] (PointerTy (VarTy "p")))
+   (const (toTemplate "$p* $NAME($p* pRef)"))
+   (const (toTemplate $ unlines [ "$DECL {"
+                                , "    $p copy = *pRef;"
+                                , joinWith "\n" (map (memberCopy typeEnv env) memberPairs)
+                                , "    $p* copyPtr = CARP_MALLOC(sizeof($p));"
+                                , "    *copyPtr = copy;"
+                                , "    return copyPtr;"
+                                , "}"]))
+   (\_ -> concatMap (depsOfPolymorphicFunction typeEnv env [] "copy" . typesCopyFunctionType)
+                    (filter (isManaged typeEnv) (map snd memberPairs)))
+
 tokensForCopy :: TypeEnv -> Env -> [(String, Ty)] -> [Token]
 tokensForCopy typeEnv env memberPairs=
   (toTemplate $ unlines [ "$DECL {"
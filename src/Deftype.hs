@@ -1,6 +1,6 @@
 {-# LANGUAGE MultiWayIf #-}
 
-module Deftype (moduleForDeftype, bindingsForRegisteredType, memberArg) where
+module Deftype (moduleForDeftype, bindingsForRegisteredType, memberArg, soaDefinitions) where
 
 import qualified Data.Map as Map
 import Data.Maybe
@@ -48,6 +48,36 @@ moduleForDeftype typeEnv env pathStrings typeName typeVariables rest i existingE
             deps = deleteDeps ++ membersDeps ++ copyDeps ++ strDeps
         return (typeModuleName, typeModuleXObj, deps)
 
+-- | The forms that '(defsoa Name [member Type, ...])' is defined with. 'NameRow' is a deftype for
+-- | a single element and 'Name' is a deftype with one Array per member, so its getters give column
+-- | access. The functions in the 'Name' module work on all columns at once.
+soaDefinitions :: String -> [(XObj, XObj)] -> Maybe Info -> [XObj]
+soaDefinitions typeName members i =
+  [ list [sym "deftype", sym rowName, arr (concat [ [name, t] | (name, t) <- members ])]
+  , list [sym "deftype", sym typeName, arr (concat [ [name, list [sym "Array", t]] | (name, t) <- members ])]
+  , list ([sym "defmodule", sym typeName] ++
+          doc "create" ("creates an empty `" ++ typeName ++ "`.") ++
+          defn "create" [] (list (qualified typeName "init" : map (const (arr [])) members)) ++
+          doc "length" "returns the number of elements in the columns of `soa`." ++
+          defn "length" ["soa"] (list [qualified "Array" "length", column (fst (head members))]) ++
+          doc "nth" "copies the element at index `i` out of the columns of `soa`." ++
+          defn "nth" ["soa", "i"] (list (qualified rowName "init" : [ copy (list [qualified "Array" "nth", column name, sym "i"]) | (name, _) <- members ])) ++
+          doc "push-back!" "appends the members of `row` to the columns of `soa`." ++
+          defn "push-back!" ["soa", "row"] (list (XObj Do i Nothing : [ list [qualified "Array" "push-back!", column name, field name] | (name, _) <- members ])) ++
+          doc "aset!" "sets the element at index `i` in the columns of `soa` to the members of `row`." ++
+          defn "aset!" ["soa", "i", "row"] (list (XObj Do i Nothing : [ list [qualified "Array" "aset!", column name, sym "i", field name] | (name, _) <- members ])))
+  ]
+  where rowName = typeName ++ "Row"
+        list xobjs = XObj (Lst xobjs) i Nothing
+        arr xobjs = XObj (Arr xobjs) i Nothing
+        sym name = XObj (Sym (SymPath [] name) Symbol) i Nothing
+        qualified moduleName name = XObj (Sym (SymPath [moduleName] name) Symbol) i Nothing
+        copy xobj = list [sym "copy", xobj]
+        doc name text = [list [sym "doc", sym name, XObj (Str text) i Nothing]]
+        defn name params body = [list [XObj Defn i Nothing, sym name, arr (map sym params), body]]
+        column name = list [qualified typeName (getName name), sym "soa"]
+        field name = copy (list [qualified rowName (getName name), list [XObj Ref i Nothing, sym "row"]])
+
 -- | Will generate getters/setters/updaters when registering EXTERNAL types.
 -- | i.e. (register-type VRUnicornData [hp Int, magic Float])
 -- | TODO: Remove duplication shared by moduleForDeftype-function.
@@ -302,26 +332,16 @@ tokensForStr typeEnv env typeName memberPairs concreteStructTy  =
   (toTemplate $ unlines [ "$DECL {"
                         , "  // convert members to String here:"
                         , "  String temp = NULL;"
-                        , "  int tempsize = 0;"
-                        , "  (void)tempsize; // that way we remove the occasional unused warning "
-                        , calculateStructStrSize typeEnv env memberPairs concreteStructTy
-                        , "  String buffer = CARP_MALLOC(size);"
-                        , "  String bufferPtr = buffer;"
+                        , "  (void)temp; // that way we remove the occasional unused warning "
+                        , "  Array b = Format_buffer(" ++ show (strBufferEstimate typeName (length memberPairs)) ++ ");"
                         , ""
-                        , "  snprintf(bufferPtr, size, \"(%s \", \"" ++ typeName ++ "\");"
-                        , "  bufferPtr += strlen(\"" ++ typeName ++ "\") + 2;\n"
+                        , "  Format_internal_append(&b, \"(" ++ typeName ++ " \", " ++ show (length typeName + 2) ++ ");"
                         , joinWith "\n" (map (memberPrn typeEnv env) memberPairs)
-                        , "  bufferPtr--;"
-                        , "  snprintf(bufferPtr, size, \")\");"
-                        , "  return buffer;"
+                        , "  b.len--;"
+                        , "  Format_internal_append(&b, \")\", 1);"
+                        , "  return Format_to_MINUS_string(b);"
                         , "}"])
 
--- | Figure out how big the string needed for the string representation of the struct has to be.
-calculateStructStrSize :: TypeEnv -> Env -> [(String, Ty)] -> Ty -> String
-calculateStructStrSize typeEnv env members structTy@(StructTy name _) =
-  "  int size = snprintf(NULL, 0, \"(%s )\", \"" ++ name ++ "\");\n" ++
-  unlines (map (memberPrnSize typeEnv env) members)
-
 -- | Generate C code for assigning to a member variable.
 -- | Needs to know if the instance is a pointer or stack variable.
 memberAssignment :: AllocationMode -> (String, Ty) -> String
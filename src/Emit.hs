@@ -80,13 +80,17 @@ instance Show ToCError where
 
 data ToCMode = Functions | Globals | All deriving Show
 
-data EmitterState = EmitterState { emitterSrc :: String }
+-- | 'emitterStackLambdas' maps the variables of lambdas whose environment lives on
+-- | the stack to the function that deletes the members of that environment.
+data EmitterState = EmitterState { emitterSrc :: String
+                                 , emitterStackLambdas :: Map.Map String String
+                                 }
 
 appendToSrc :: String -> State EmitterState ()
 appendToSrc moreSrc = modify (\s -> s { emitterSrc = emitterSrc s ++ moreSrc })
 
 toC :: ToCMode -> XObj -> String
-toC toCMode root = emitterSrc (execState (visit startingIndent root) (EmitterState ""))
+toC toCMode root = emitterSrc (execState (visit startingIndent root) (EmitterState "" Map.empty))
   where startingIndent = case toCMode of
                            Functions -> 0
                            Globals -> 4
@@ -175,6 +179,41 @@ toC toCMode root = emitterSrc (execState (visit startingIndent root) (EmitterSta
         visitSymbol _ xobj@(XObj (Sym path _) Nothing _) = error ("Symbol missing info: " ++ show xobj)
         visitSymbol _ _ = error "Not a symbol."
 
+        visitLambda :: Int -> Info -> Maybe SymPath -> Set.Set XObj -> Bool -> State EmitterState String
+        visitLambda indent i name set envOnStack =
+          do let retVar = freshVar i
+                 capturedVars = Set.toList set
+                 Just callback = name
+                 callbackMangled = pathToC callback
+                 needEnv = not (null capturedVars)
+                 lambdaEnvTypeName = callbackMangled ++ "_env" -- The name of the struct is the callback name with suffix '_env'.
+                 lambdaEnvType = StructTy lambdaEnvTypeName []
+                 lambdaEnvName = freshVar i ++ "_env"
+             appendToSrc (addIndent indent ++ "// This lambda captures " ++
+                          show (length capturedVars) ++ " variables: " ++
+                          joinWithComma (map getName capturedVars) ++ "\n")
+             when needEnv $
+               do if envOnStack
+                    then do appendToSrc (addIndent indent ++ tyToC lambdaEnvType ++ " " ++ lambdaEnvName ++ "_storage;\n")
+                            appendToSrc (addIndent indent ++ tyToC lambdaEnvType ++ " *" ++ lambdaEnvName ++
+                                         " = &" ++ lambdaEnvName ++ "_storage;\n")
+                            -- The lambda is deleted by deleting the members of its environment, see 'delete'.
+                            modify (\s -> s { emitterStackLambdas = Map.insert retVar (lambdaEnvTypeName ++ "_delete")
+                                                                                (emitterStackLambdas s) })
+                    else appendToSrc (addIndent indent ++ tyToC lambdaEnvType ++ " *" ++ lambdaEnvName ++
+                                      " = CARP_MALLOC(sizeof(" ++ tyToC lambdaEnvType ++ "));\n")
+                  mapM_ (\(XObj (Sym path _) _ _) ->
+                           appendToSrc (addIndent indent ++ lambdaEnvName ++ "->" ++
+                                        pathToC path ++ " = " ++ pathToC path ++ ";\n"))
+                    capturedVars
+             appendToSrc (addIndent indent ++ "Lambda " ++ retVar ++ " = {\n")
+             appendToSrc (addIndent indent ++ "  .callback = " ++ callbackMangled ++ ",\n")
+             appendToSrc (addIndent indent ++ "  .env = " ++ (if needEnv then lambdaEnvName else "NULL")  ++ ",\n")
+             appendToSrc (addIndent indent ++ "  .delete = " ++ (if needEnv then "" ++ lambdaEnvTypeName ++ "_delete" else "NULL")  ++ ",\n")
+             appendToSrc (addIndent indent ++ "  .copy = " ++ (if needEnv then "" ++ lambdaEnvTypeName ++ "_copy" else "NULL")  ++ "\n")
+             appendToSrc (addIndent indent ++ "};\n")
+             return retVar
+
         visitList :: Int -> XObj -> State EmitterState String
         visitList indent (XObj (Lst xobjs) (Just i) t) =
           case xobjs of
@@ -201,31 +240,7 @@ toC toCMode root = emitterSrc (execState (visit startingIndent root) (EmitterSta
 
             -- Fn / λ
             [XObj (Fn name set) _ _, XObj (Arr argList) _ _, body] ->
-              do let retVar = freshVar i
-                     capturedVars = Set.toList set
-                     Just callback = name
-                     callbackMangled = pathToC callback
-                     needEnv = not (null capturedVars)
-                     lambdaEnvTypeName = callbackMangled ++ "_env" -- The name of the struct is the callback name with suffix '_env'.
-                     lambdaEnvType = StructTy lambdaEnvTypeName []
-                     lambdaEnvName = freshVar i ++ "_env"
-                 appendToSrc (addIndent indent ++ "// This lambda captures " ++
-                              show (length capturedVars) ++ " variables: " ++
-                              joinWithComma (map getName capturedVars) ++ "\n")
-                 when needEnv $
-                   do appendToSrc (addIndent indent ++ tyToC lambdaEnvType ++ " *" ++ lambdaEnvName ++
-                                   " = CARP_MALLOC(sizeof(" ++ tyToC lambdaEnvType ++ "));\n")
-                      mapM_ (\(XObj (Sym path _) _ _) ->
-                               appendToSrc (addIndent indent ++ lambdaEnvName ++ "->" ++
-                                            pathToC path ++ " = " ++ pathToC path ++ ";\n"))
-                        capturedVars
-                 appendToSrc (addIndent indent ++ "Lambda " ++ retVar ++ " = {\n")
-                 appendToSrc (addIndent indent ++ "  .callback = " ++ callbackMangled ++ ",\n")
-                 appendToSrc (addIndent indent ++ "  .env = " ++ (if needEnv then lambdaEnvName else "NULL")  ++ ",\n")
-                 appendToSrc (addIndent indent ++ "  .delete = " ++ (if needEnv then "" ++ lambdaEnvTypeName ++ "_delete" else "NULL")  ++ ",\n")
-                 appendToSrc (addIndent indent ++ "  .copy = " ++ (if needEnv then "" ++ lambdaEnvTypeName ++ "_copy" else "NULL")  ++ "\n")
-                 appendToSrc (addIndent indent ++ "};\n")
-                 return retVar
+              visitLambda indent i name set False
 
             -- Def
             [XObj Def _ _, XObj (Sym path _) _ _, expr] ->
@@ -373,10 +388,9 @@ toC toCMode root = emitterSrc (execState (visit startingIndent root) (EmitterSta
                        where visitWhileExpression :: Int -> State EmitterState String
                              visitWhileExpression ind =
                                do s <- get
-                                  let (exprRetVar, exprResultState) = runState (visit ind expr) (EmitterState "")
+                                  let (exprRetVar, exprResultState) = runState (visit ind expr) (s { emitterSrc = "" })
                                       exprSrc = emitterSrc exprResultState
-                                  modify (\x -> x { emitterSrc = emitterSrc s ++ exprSrc
-                                                  })
+                                  put (exprResultState { emitterSrc = emitterSrc s ++ exprSrc })
                                   return exprRetVar
 
             -- Do
@@ -422,6 +436,15 @@ toC toCMode root = emitterSrc (execState (visit startingIndent root) (EmitterSta
                  return fresh
 
             -- Ref
+            [XObj Ref _ _, XObj (Lst [XObj (Fn name set) _ _, _, _]) (Just fni) _] ->
+              -- A lambda that is only referenced can't outlive the scope it's created in,
+              -- so its environment can be allocated on the stack.
+              do var <- visitLambda indent fni name set True
+                 let Just t' = t
+                     fresh = mangle (freshVar i)
+                 appendToSrc (addIndent indent ++ tyToCLambdaFix t' ++ " " ++ fresh ++ " = &" ++ var ++ "; // ref\n")
+                 return fresh
+
             [XObj Ref _ _, value] ->
               do var <- visit indent value
                  let Just t' = t
@@ -596,7 +619,13 @@ delete indent i = mapM_ deleterToC (infoDelete i)
         deleterToC FakeDeleter {} =
           return ()
         deleterToC deleter@ProperDeleter{} =
-          appendToSrc $ addIndent indent ++ "" ++ pathToC (deleterPath deleter) ++ "(" ++ mangle (deleterVariable deleter) ++ ");\n"
+          do stackLambdas <- gets emitterStackLambdas
+             case Map.lookup (deleterVariable deleter) stackLambdas of
+               -- Lambdas with their environment on the stack only need to delete what they captured:
+               Just envDeleter ->
+                 appendToSrc $ addIndent indent ++ envDeleter ++ "(" ++ mangle (deleterVariable deleter) ++ ".env);\n"
+               Nothing ->
+                 appendToSrc $ addIndent indent ++ "" ++ pathToC (deleterPath deleter) ++ "(" ++ mangle (deleterVariable deleter) ++ ");\n"
 
 defnToDeclaration :: SymPath -> [XObj] -> Ty -> String
 defnToDeclaration path@(SymPath _ name) argList retTy =
@@ -644,7 +673,7 @@ defStructToDeclaration structTy@(StructTy typeName typeVariables) path rest =
 
   in if isTypeGeneric structTy
      then "" -- ("// " ++ show structTy ++ "\n")
-     else emitterSrc (execState visit (EmitterState ""))
+     else emitterSrc (execState visit (EmitterState "" Map.empty))
 
 defSumtypeToDeclaration sumTy@(StructTy typeName typeVariables) path rest =
   let indent = indentAmount
@@ -675,7 +704,7 @@ defSumtypeToDeclaration sumTy@(StructTy typeName typeVariables) path rest =
 
   in if isTypeGeneric sumTy
      then ""
-     else emitterSrc (execState visit (EmitterState ""))
+     else emitterSrc (execState visit (EmitterState "" Map.empty))
 
 defaliasToDeclaration :: Ty -> SymPath -> String
 defaliasToDeclaration t path =
@@ -208,7 +208,15 @@ eval env xobj =
           return (makeEvalError ctx Nothing (show "Invalid args to `register-type`: " ++ pretty xobj) (info xobj))
 
         XObj (Sym (SymPath [] "deftype") _) _ _ : nameXObj : rest ->
-          specialCommandDeftype nameXObj rest
+          specialCommandDeftype False nameXObj rest
+
+        XObj (Sym (SymPath [] "deftype-pod") _) _ _ : nameXObj : rest ->
+          specialCommandDeftype True nameXObj rest
+
+        [XObj (Sym (SymPath [] "defsoa") _) _ _, XObj (Sym (SymPath [] typeName) _) _ _, XObj (Arr members) _ _] ->
+          specialCommandDefsoa xobj typeName members
+        XObj (Sym (SymPath [] "defsoa") _) _ _ : _ ->
+          return (makeEvalError ctx Nothing ("Invalid args to `defsoa`: " ++ pretty xobj) (info xobj))
 
         [XObj (Sym (SymPath [] "register") _) _ _, XObj (Sym (SymPath _ name) _) _ _, typeXObj] ->
           specialCommandRegister name typeXObj Nothing
@@ -669,17 +677,21 @@ specialCommandRegisterType typeName rest =
                    put contextWithDefs
                    return dynamicNil
 
-specialCommandDeftype :: XObj -> [XObj] -> StateT Context IO (Either EvalError XObj)
-specialCommandDeftype nameXObj@(XObj (Sym (SymPath _ typeName) _) _ _) rest =
-  deftypeInternal nameXObj typeName [] rest
-specialCommandDeftype (XObj (Lst (nameXObj@(XObj (Sym (SymPath _ typeName) _) _ _) : typeVariables)) _ _) rest =
-  deftypeInternal nameXObj typeName typeVariables rest
-specialCommandDeftype nameXObj _ =
+-- | 'deftype-pod' defines a struct of unmanaged members that is copied like an Int (see 'isManaged').
+specialCommandDeftype :: Bool -> XObj -> [XObj] -> StateT Context IO (Either EvalError XObj)
+specialCommandDeftype pod nameXObj@(XObj (Sym (SymPath _ typeName) _) _ _) rest =
+  deftypeInternal pod nameXObj typeName [] rest
+specialCommandDeftype False (XObj (Lst (nameXObj@(XObj (Sym (SymPath _ typeName) _) _ _) : typeVariables)) _ _) rest =
+  deftypeInternal False nameXObj typeName typeVariables rest
+specialCommandDeftype True nameXObj@(XObj (Lst _) _ _) _ =
+  do ctx <- get
+     return (makeEvalError ctx Nothing ("A type defined with `deftype-pod` can't have type variables: " ++ pretty nameXObj) (info nameXObj))
+specialCommandDeftype _ nameXObj _ =
   do ctx <- get
      return (makeEvalError ctx Nothing ("Invalid name for type definition: " ++ pretty nameXObj) (info nameXObj))
 
-deftypeInternal :: XObj -> String -> [XObj] -> [XObj] -> StateT Context IO (Either EvalError XObj)
-deftypeInternal nameXObj typeName typeVariableXObjs rest =
+deftypeInternal :: Bool -> XObj -> String -> [XObj] -> [XObj] -> StateT Context IO (Either EvalError XObj)
+deftypeInternal pod nameXObj typeName typeVariableXObjs rest =
   do ctx <- get
      let pathStrings = contextPath ctx
          fppl = projectFilePathPrintLength (contextProj ctx)
@@ -690,7 +702,14 @@ deftypeInternal nameXObj typeName typeVariableXObjs rest =
                                Just (_, Binder _ (XObj (Mod found) _ _)) -> Just found
                                _ -> Nothing
          (creatorFunction, typeConstructor) = if length rest == 1 then (moduleForDeftype, Typ) else (moduleForSumtype, DefSumtype)
+         managedMembers = case rest of
+                            [XObj (Arr members) _ _] ->
+                              [ member | (member, memberTy) <- pairwise members
+                                       , maybe True (isManaged typeEnv) (xobjToTy memberTy) ]
+                            _ -> []
      case (nameXObj, typeVariables) of
+       _ | pod && length rest /= 1 ->
+         return (makeEvalError ctx Nothing ("A type defined with `deftype-pod` must be a struct: " ++ pretty nameXObj) (info nameXObj))
        (XObj (Sym (SymPath _ typeName) _) i _, Just okTypeVariables) ->
          case creatorFunction typeEnv env pathStrings typeName okTypeVariables rest i preExistingModule of
            Right (typeModuleName, typeModuleXObj, deps) ->
@@ -701,23 +720,39 @@ deftypeInternal nameXObj typeName typeVariableXObjs rest =
                               XObj (Sym (SymPath pathStrings typeName) Symbol) Nothing Nothing :
                               rest)
                         ) i (Just TypeTy)
+                 typeMeta = if pod
+                            then MetaData (Map.fromList [("pod", XObj (Bol True) Nothing Nothing)])
+                            else emptyMeta
                  ctx' = (ctx { contextGlobalEnv = envInsertAt env (SymPath pathStrings typeModuleName) (Binder emptyMeta typeModuleXObj)
-                             , contextTypeEnv = TypeEnv (extendEnv (getTypeEnv typeEnv) typeName typeDefinition)
+                             , contextTypeEnv = TypeEnv (envAddBinding (getTypeEnv typeEnv) typeName (Binder typeMeta typeDefinition))
                              })
-             in do ctxWithDeps <- liftIO (foldM (define True) ctx' deps)
-                   let ctxWithInterfaceRegistrations =
-                         foldM (\context (path, sig) -> registerInInterfaceIfNeeded context path sig) ctxWithDeps
-                               [((SymPath (pathStrings ++ [typeModuleName]) "str"), FuncTy [(RefTy structTy)] StringTy)
-                               ,((SymPath (pathStrings ++ [typeModuleName]) "copy"), FuncTy [RefTy structTy] structTy)]
-                   case ctxWithInterfaceRegistrations of
-                     Left err -> liftIO (putStrLnWithColor Red err)
-                     Right ok -> put ok
-                   return dynamicNil
+             in if pod && not (null managedMembers)
+                then return (makeEvalError ctx Nothing ("A type defined with `deftype-pod` can only have members that don't need to be deleted, like numbers or other `deftype-pod` types, but '" ++ pretty nameXObj ++ "' has " ++ joinWithComma (map pretty managedMembers) ++ ".") (info nameXObj))
+                else do ctxWithDeps <- liftIO (foldM (define True) ctx' deps)
+                        let ctxWithInterfaceRegistrations =
+                              foldM (\context (path, sig) -> registerInInterfaceIfNeeded context path sig) ctxWithDeps
+                                    [((SymPath (pathStrings ++ [typeModuleName]) "str"), FuncTy [(RefTy structTy)] StringTy)
+                                    ,((SymPath (pathStrings ++ [typeModuleName]) "copy"), FuncTy [RefTy structTy] structTy)]
+                        case ctxWithInterfaceRegistrations of
+                          Left err -> liftIO (putStrLnWithColor Red err)
+                          Right ok -> put ok
+                        return dynamicNil
            Left err ->
              return (makeEvalError ctx (Just err) ("Invalid type definition for '" ++ pretty nameXObj ++ "':\n\n" ++ show err) Nothing)
        (_, Nothing) ->
          return (makeEvalError ctx Nothing ("Invalid type variables for type definition: " ++ pretty nameXObj) (info nameXObj))
 
+-- | 'defsoa' is defined in terms of deftype and defmodule, see 'soaDefinitions'.
+specialCommandDefsoa :: XObj -> String -> [XObj] -> StateT Context IO (Either EvalError XObj)
+specialCommandDefsoa xobj typeName members =
+  do ctx <- get
+     if null members || odd (length members)
+       then return (makeEvalError ctx Nothing ("`defsoa` needs at least one member, with a type for every member: " ++ pretty xobj) (info xobj))
+       else foldM evalForm dynamicNil (soaDefinitions typeName (pairwise members) (info xobj))
+  where evalForm (Left err) _ = return (Left err)
+        evalForm (Right _) form = do ctx <- get
+                                     eval (contextGlobalEnv ctx) form
+
 specialCommandRegister :: String -> XObj -> Maybe String -> StateT Context IO (Either EvalError XObj)
 specialCommandRegister name typeXObj overrideName =
   do ctx <- get
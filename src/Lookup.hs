@@ -186,12 +186,13 @@ isExternalType _ _ =
   False
 
 -- | Is this type managed - does it need to be freed?
+-- | Types defined with 'deftype-pod' are not, they are copied and passed around like numbers.
 isManaged :: TypeEnv -> Ty -> Bool
 isManaged typeEnv (StructTy name _) =
   (name == "Array") || (name == "Dictionary") || (
     case lookupInEnv (SymPath [] name) (getTypeEnv typeEnv) of
          Just (_, Binder _ (XObj (Lst (XObj ExternalType _ _ : _)) _ _)) -> False
-         Just (_, Binder _ (XObj (Lst (XObj (Typ _) _ _ : _)) _ _)) -> True
+         Just (_, Binder meta (XObj (Lst (XObj (Typ _) _ _ : _)) _ _)) -> not (metaIsTrue meta "pod")
          Just (_, Binder _ (XObj (Lst (XObj (DefSumtype _) _ _ : _)) _ _)) -> True
          Just (_, Binder _ (XObj wrong _ _)) -> error ("Invalid XObj in type env: " ++ show wrong)
          Nothing -> error ("Can't find " ++ name ++ " in type env.") -- TODO: Please don't crash here!
@@ -201,6 +202,12 @@ isManaged _ PatternTy = True
 isManaged _ (FuncTy _ _) = True
 isManaged _ _ = False
 
+-- | Can a value of this type be copied with memcpy, without calling its copy function?
+-- | External types are left out since their copy functions can do anything.
+isTriviallyCopyable :: TypeEnv -> Ty -> Bool
+isTriviallyCopyable typeEnv t =
+  not (isManaged typeEnv t) && not (isExternalType typeEnv t) && not (isTypeGeneric t)
+
 -- | Is this type a function type?
 isFunctionType :: Ty -> Bool
 isFunctionType (FuncTy _ _) = True
@@ -154,6 +154,16 @@ instance Show FilePathPrintLength where
   show FullPath = "full"
   show ShortPath = "short"
 
+-- | Which phase of profile guided optimization a build is in.
+data PgoMode = NoPgo
+             | PgoGenerate
+             | PgoUse deriving Eq
+
+instance Show PgoMode where
+  show NoPgo = "off"
+  show PgoGenerate = "generate"
+  show PgoUse = "use"
+
 machineReadableInfo :: FilePathPrintLength -> Info -> String
 machineReadableInfo filePathPrintLength i =
   let line = infoLine i
@@ -504,6 +514,10 @@ data Project = Project { projectTitle :: String
                        , projectEchoCompilationCommand :: Bool
                        , projectCanExecute :: Bool
                        , projectFilePathPrintLength :: FilePathPrintLength
+                       , projectSkipIdenticalBuilds :: Bool
+                       , projectPgo :: PgoMode
+                       , projectLto :: Bool
+                       , projectMarch :: String
                        }
 
 projectFlags :: Project -> String
@@ -534,6 +548,10 @@ instance Show Project where
         echoCompilationCommand
         canExecute
         filePathPrintLength
+        skipIdenticalBuilds
+        pgo
+        lto
+        march
        ) =
     unlines [ "Title: " ++ title
             , "Compiler: " ++ compiler
@@ -558,6 +576,10 @@ instance Show Project where
             , "Search paths for 'load' command:\n    " ++ joinWith  "\n    " searchPaths
             , "Print AST (with 'info' command): " ++ if printTypedAST then "true" else "false"
             , "File path print length (when using --check): " ++ show filePathPrintLength
+            , "Skip identical builds: " ++ if skipIdenticalBuilds then "true" else "false"
+            , "Profile guided optimization: " ++ show pgo
+            , "Link time optimization: " ++ if lto then "true" else "false"
+            , "Target architecture: " ++ (if march == "" then "default" else march)
             ]
 
 -- | Represent the inclusion of a C header file, either like <string.h> or "string.h"
@@ -59,6 +59,8 @@ completeKeywordsAnd words _ word = return $ findKeywords word (words ++ keywords
                    , "expand"
 
                    , "deftype"
+                   , "deftype-pod"
+                   , "defsoa"
 
                    , "register"
 
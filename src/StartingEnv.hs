@@ -34,6 +34,7 @@ arrayModule = Env { envBindings = bindings
                                 , templateAset
                                 , templateAsetBang
                                 , templateAsetUninitializedBang
+                                , templateReplaceBang
                                 , templateLength
                                 , templatePushBack
                                 , templatePushBackBang
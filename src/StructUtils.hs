@@ -6,45 +6,42 @@ import Util
 import Lookup
 import Polymorphism
 
--- | Generate C code for converting a member variable to a string and appending it to a buffer.
+-- | The C function that appends the string representation of a primitive
+-- | type to a Format buffer directly, without allocating a String for it.
+-- | Only for types whose 'prn' is the same as their 'str'.
+primitiveStrInto :: Ty -> Maybe String
+primitiveStrInto IntTy = Just "Int_str_MINUS_into"
+primitiveStrInto LongTy = Just "Long_str_MINUS_into"
+primitiveStrInto FloatTy = Just "Float_str_MINUS_into"
+primitiveStrInto DoubleTy = Just "Double_str_MINUS_into"
+primitiveStrInto BoolTy = Just "Bool_str_MINUS_into"
+primitiveStrInto _ = Nothing
+
+-- | A first guess at the length of the string representation of a struct
+-- | or sum type case, so that the buffer rarely has to grow while it is written.
+strBufferEstimate :: String -> Int -> Int
+strBufferEstimate typeName memberCount = length typeName + 3 + 16 * memberCount
+
+-- | Generate C code for converting a member variable to a string and appending it to the buffer 'b'.
 memberPrn :: TypeEnv -> Env -> (String, Ty) -> String
 memberPrn typeEnv env (memberName, memberTy) =
   let refOrNotRefType = if isManaged typeEnv memberTy then RefTy memberTy else memberTy
       maybeTakeAddress = if isManaged typeEnv memberTy then "&" else ""
       strFuncType = FuncTy [refOrNotRefType] StringTy
-   in case nameOfPolymorphicFunction typeEnv env strFuncType "prn" of
-        Just strFunctionPath ->
-          unlines ["  temp = " ++ pathToC strFunctionPath ++ "(" ++ maybeTakeAddress ++ "p->" ++ memberName ++ ");"
-                  , "  snprintf(bufferPtr, size, \"%s \", temp);"
-                  , "  bufferPtr += strlen(temp) + 1;"
-                  , "  if(temp) { CARP_FREE(temp); temp = NULL; }"
+   in case primitiveStrInto memberTy of
+        Just strIntoFunction ->
+          unlines [ "  " ++ strIntoFunction ++ "(&b, p->" ++ memberName ++ ");"
+                  , "  Format_internal_append(&b, \" \", 1);"
                   ]
         Nothing ->
-          if isExternalType typeEnv memberTy
-          then unlines [ "  tempsize = snprintf(NULL, 0, \"%p\", p->" ++ memberName ++ ");"
-                       , "  temp = malloc(tempsize);"
-                       , "  snprintf(temp, tempsize, \"%p\", p->" ++ memberName ++ ");"
-                       , "  snprintf(bufferPtr, size, \"%s \", temp);"
-                       , "  bufferPtr += strlen(temp) + 1;"
-                       , "  if(temp) { CARP_FREE(temp); temp = NULL; }"
-                       ]
-          else "  // Failed to find str function for " ++ memberName ++ " : " ++ show memberTy ++ "\n"
-
--- | Calculate the size for prn:ing a member of a struct
-memberPrnSize :: TypeEnv -> Env -> (String, Ty) -> String
-memberPrnSize typeEnv env (memberName, memberTy) =
-  let refOrNotRefType = if isManaged typeEnv memberTy then RefTy memberTy else memberTy
-      maybeTakeAddress = if isManaged typeEnv memberTy then "&" else ""
-      strFuncType = FuncTy [refOrNotRefType] StringTy
-  in case nameOfPolymorphicFunction typeEnv env strFuncType "prn" of
-       Just strFunctionPath ->
-         unlines ["  temp = " ++ pathToC strFunctionPath ++ "(" ++ maybeTakeAddress ++ "p->" ++ memberName ++ "); "
-                 ,"  size += snprintf(NULL, 0, \"%s \", temp);"
-                 ,"  if(temp) { CARP_FREE(temp); temp = NULL; }"
-                 ]
-       Nothing ->
-         if isExternalType typeEnv memberTy
-         then unlines ["  size +=  snprintf(NULL, 0, \"%p \", p->" ++ memberName ++ ");"
-                      ,"  if(temp) { CARP_FREE(temp); temp = NULL; }"
+          case nameOfPolymorphicFunction typeEnv env strFuncType "prn" of
+            Just strFunctionPath ->
+              unlines ["  temp = " ++ pathToC strFunctionPath ++ "(" ++ maybeTakeAddress ++ "p->" ++ memberName ++ ");"
+                      , "  Format_internal_append(&b, temp, strlen(temp));"
+                      , "  Format_internal_append(&b, \" \", 1);"
+                      , "  if(temp) { CARP_FREE(temp); temp = NULL; }"
                       ]
-         else "  // Failed to find str function for " ++ memberName ++ " : " ++ show memberTy ++ "\n"
+            Nothing ->
+              if isExternalType typeEnv memberTy
+              then "  CARP_FORMAT_SNPRINTF(&b, \"%p \", p->" ++ memberName ++ ");\n"
+              else "  // Failed to find str function for " ++ memberName ++ " : " ++ show memberTy ++ "\n"
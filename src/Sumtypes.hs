@@ -166,15 +166,13 @@ tokensForStr typeEnv env typeName cases concreteStructTy  =
   (toTemplate $ unlines [ "$DECL {"
                         , "  // convert members to String here:"
                         , "  String temp = NULL;"
-                        , "  int tempsize = 0;"
-                        , "  (void)tempsize; // that way we remove the occasional unused warning "
-                        , calculateStructStrSize typeEnv env cases concreteStructTy
-                        , "  String buffer = CARP_MALLOC(size);"
-                        , "  String bufferPtr = buffer;"
+                        , "  (void)temp; // that way we remove the occasional unused warning "
+                        , "  Array b = Format_buffer(" ++ show (maximum (0 : map caseEstimate cases)) ++ ");"
                         , ""
                         , (concatMap (strCase typeEnv env concreteStructTy) cases)
-                        , "  return buffer;"
+                        , "  return Format_to_MINUS_string(b);"
                         , "}"])
+  where caseEstimate theCase = strBufferEstimate (caseName theCase) (length (caseTys theCase))
 
 strCase :: TypeEnv -> Env -> Ty -> SumtypeCase -> String
 strCase typeEnv env concreteStructTy@(StructTy _ typeVariables) theCase =
@@ -183,33 +181,11 @@ strCase typeEnv env concreteStructTy@(StructTy _ typeVariables) theCase =
       correctedTagName = tagName concreteStructTy name
   in unlines $
      [ "  if(p->_tag == " ++ correctedTagName ++ ") {"
-     , "    snprintf(bufferPtr, size, \"(%s \", \"" ++ name ++ "\");"
-     , "    bufferPtr += strlen(\"" ++ name ++ "\") + 2;\n"
+     , "    Format_internal_append(&b, \"(" ++ name ++ " \", " ++ show (length name + 2) ++ ");"
      , joinWith "\n" (map (memberPrn typeEnv env) (zip (map (\anon -> name ++ "." ++ anon)
                                                        anonMemberNames) tys))
-     , "    bufferPtr--;"
-     , "    snprintf(bufferPtr, size, \")\");"
-     , "  }"
-     ]
-
--- | Figure out how big the string needed for the string representation of the struct has to be.
-calculateStructStrSize :: TypeEnv -> Env -> [SumtypeCase] -> Ty -> String
-calculateStructStrSize typeEnv env cases structTy@(StructTy name _) =
-  "  int size = 1;\n" ++
-  concatMap (strSizeCase typeEnv env structTy) cases
-
-strSizeCase :: TypeEnv -> Env -> Ty -> SumtypeCase -> String
-strSizeCase typeEnv env concreteStructTy@(StructTy _ typeVariables) theCase =
-  let name = caseName theCase
-      tys  = caseTys  theCase
-      correctedTagName = tagName concreteStructTy name
-  in unlines $
-     [ "  if(p->_tag == " ++ correctedTagName ++ ") {"
-     , "    size += snprintf(NULL, 0, \"(%s \", \"" ++ name ++ "\");"
-     , joinWith "\n" (map
-                      (memberPrnSize typeEnv env)
-                      (zip (map (\anon -> name ++ "." ++ anon) anonMemberNames)
-                           tys))
+     , "    b.len--;"
+     , "    Format_internal_append(&b, \")\", 1);"
      , "  }"
      ]
 
@@ -160,6 +160,7 @@ consPath qualifyers (SymPath stringPaths name) =
   SymPath (qualifyers ++ stringPaths) name
 
 -- | Replaces symbols not allowed in C-identifiers.
+-- | The profiler in core/carp_profile.h reverses this (and pathToC), keep them in sync.
 mangle :: String -> String
 mangle = replaceChars (Map.fromList [('+', "_PLUS_")
                                     ,('-', "_MINUS_")
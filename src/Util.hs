@@ -4,6 +4,10 @@ import Data.List
 import qualified Data.Map as Map
 import qualified Data.Set as Set
 import Data.Maybe (fromMaybe)
+import Data.Bits (xor)
+import Data.Char (ord)
+import Data.Word (Word64)
+import Numeric (showHex)
 import System.Info (os)
 
 joinWith :: String -> [String] -> String
@@ -35,6 +39,12 @@ toEither a b = case a of
                  Just ok -> Right ok
                  Nothing -> Left b
 
+-- | A 64 bit FNV-1a hash of a string, as hexadecimal. Not cryptographic, only used to detect changes.
+hashString :: String -> String
+hashString s = showHex (foldl' step 14695981039346656037 s) ""
+  where step :: Word64 -> Char -> Word64
+        step h c = (h `xor` fromIntegral (ord c)) * 1099511628211
+
 replaceChars :: Map.Map Char String -> String -> String
 replaceChars dict = concatMap replacer
   where replacer c = fromMaybe [c] (Map.lookup c dict)
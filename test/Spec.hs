@@ -7,9 +7,11 @@ import Obj
 import Parsing
 import Infer
 import Eval
+import Concretize
 
 main :: IO ()
 main = do _ <- runTestTT (groupTests "Constraints" testConstraints)
+          _ <- runTestTT (groupTests "Specialization" testSpecializations)
           return ()
 
 groupTests :: String -> [Test] -> Test
@@ -183,3 +185,50 @@ testConstr35 = assertSolution
   ,("x1", (VarTy "x0"))
   ,("y1", (VarTy "y0"))
   ]
+
+-- | Specialization of higher order functions on the functions passed to them
+typed :: Ty -> Obj -> XObj
+typed t o = XObj o Nothing (Just t)
+
+intToInt = FuncTy [IntTy] IntTy
+twiceTy = FuncTy [intToInt, IntTy] IntTy
+
+localF = typed intToInt (Sym (SymPath [] "f") (LookupLocal NoCapture))
+localX = typed IntTy (Sym (SymPath [] "x") (LookupLocal NoCapture))
+globalInc = typed intToInt (Sym (SymPath ["Int"] "inc") (LookupGlobal CarpLand AFunction))
+call f arg = typed IntTy (Lst [f, arg])
+
+-- | (defn twice [f x] <body>)
+twice body = typed twiceTy (Lst [XObj Defn Nothing Nothing
+                                ,typed twiceTy (Sym (SymPath [] "twice") Symbol)
+                                ,XObj (Arr [typed intToInt (Sym (SymPath [] "f") Symbol)
+                                           ,typed IntTy (Sym (SymPath [] "x") Symbol)]) Nothing Nothing
+                                ,body])
+
+specializedBody (Just (XObj (Lst [_, _, _, body]) _ _)) = Just (pretty body)
+specializedBody _ = Nothing
+
+testSpecializations = [testSpecialize1, testSpecialize2, testSpecialize3, testSpecialize4]
+
+-- The function passed is called directly
+testSpecialize1 = TestCase $
+  assertEqual "Body" (Just (pretty (call globalInc (call globalInc localX))))
+                     (specializedBody (specializeDefinition (twice (call localF (call localF localX))) [globalInc, localX]))
+
+-- Nothing to specialize when no function is known
+testSpecialize2 = TestCase $
+  assertEqual "Nothing" Nothing
+                        (specializeDefinition (twice (call localF localX)) [localF, localX])
+
+-- A parameter that is given a new value with set! can't be replaced
+testSpecialize3 = TestCase $
+  assertEqual "Nothing" Nothing
+                        (specializeDefinition (twice (typed IntTy (Lst [XObj Do Nothing Nothing
+                                                                       ,typed UnitTy (Lst [XObj SetBang Nothing Nothing, localF, globalInc])
+                                                                       ,call localF localX])))
+                                              [globalInc, localX])
+
+-- A redefined function gets a copy of its own
+testSpecialize4 = TestCase $
+  assertBool "Different paths" (fmap getPath (specializeDefinition (twice (call localF localX)) [globalInc, localX]) /=
+                                fmap getPath (specializeDefinition (twice (call localF (call localF localX))) [globalInc, localX]))